@@ -0,0 +1,111 @@
+#include "actuated.h"
+#include "sys/alt_irq.h"
+
+// Default timing, in ticks (ms). The same for both approaches.
+#define MIN_GREEN 3000
+#define PASSAGE 2000
+#define MAX_GREEN 12000
+
+void actuated_init(Actuated *actuated) {
+	int i;
+	for (i = 0; i < APPROACHES; i++) {
+		actuated->timing[i].min_green = MIN_GREEN;
+		actuated->timing[i].passage = PASSAGE;
+		actuated->timing[i].max_green = MAX_GREEN;
+		actuated->last_call[i] = 0;
+		actuated->demand[i] = 0;
+	}
+	actuated->green = -1;
+	actuated->green_start = 0;
+	actuated->extensions = 0;
+	actuated->gap_outs = 0;
+	actuated->max_outs = 0;
+	actuated->skips = 0;
+}
+
+void actuated_detect(Actuated *actuated, int approach, alt_u32 now) {
+	// A vehicle was detected on "approach". Called from the button ISR.
+	actuated->last_call[approach] = now;
+	actuated->detections[approach]++;
+	if (actuated->green != approach) {
+		actuated->demand[approach] = 1;
+	}
+}
+
+int actuated_skip(Actuated *actuated, int approach, int walk_here, int walk_other) {
+	// Called in the all red state before "approach" turns green. Returns 1 if its
+	// green should be skipped: nobody is waiting there and someone is waiting on
+	// the other approach. With no demand anywhere both approaches are served in turn.
+	int other = approach == APPROACH_NS ? APPROACH_EW : APPROACH_NS;
+
+	if (actuated->demand[approach] || walk_here) {
+		return 0;
+	}
+	if (!actuated->demand[other] && !walk_other) {
+		return 0;
+	}
+	actuated->skips++;
+	return 1;
+}
+
+alt_u32 actuated_green_start(Actuated *actuated, int approach, alt_u32 now) {
+	// "approach" has turned green. Returns the minimum green to time.
+	const ActuatedTiming *timing = &actuated->timing[approach];
+
+	actuated->green = approach;
+	actuated->green_start = now;
+	actuated->demand[approach] = 0;
+	// Only vehicles arriving during this green can extend it.
+	actuated->last_call[approach] = now - timing->passage;
+	return timing->min_green;
+}
+
+alt_u32 actuated_green_extend(Actuated *actuated, alt_u32 now) {
+	// Called when the green reaches its deadline. Returns the ticks to extend it
+	// by, or 0 when it should end (gap out or max out).
+	const ActuatedTiming *timing;
+	alt_u32 elapsed;
+	alt_u32 gap;
+	alt_u32 extend;
+
+	if (actuated->green < 0) {
+		return 0;
+	}
+	timing = &actuated->timing[actuated->green];
+	elapsed = now - actuated->green_start;
+	gap = now - actuated->last_call[actuated->green];
+
+	if (gap >= timing->passage) {
+		actuated->gap_outs++;
+		actuated->green = -1;
+		return 0;
+	}
+	if (elapsed >= timing->max_green) {
+		actuated->max_outs++;
+		actuated->green = -1;
+		return 0;
+	}
+	// Run until the passage time after the last vehicle, but not past the maximum.
+	extend = timing->passage - gap;
+	if (extend > timing->max_green - elapsed) {
+		extend = timing->max_green - elapsed;
+	}
+	actuated->extensions++;
+	return extend;
+}
+
+void actuated_report(FILE *out, Actuated *actuated) {
+	// Copy with interrupts disabled, since the alarm callback and button ISR update it.
+	Actuated copy;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *actuated;
+	alt_irq_enable_all(context);
+
+	fprintf(out, "EW green min %lu passage %lu max %lu ticks\n\r", copy.timing[APPROACH_EW].min_green,
+			copy.timing[APPROACH_EW].passage, copy.timing[APPROACH_EW].max_green);
+	fprintf(out, "NS green min %lu passage %lu max %lu ticks\n\r", copy.timing[APPROACH_NS].min_green,
+			copy.timing[APPROACH_NS].passage, copy.timing[APPROACH_NS].max_green);
+	fprintf(out, "Extensions %lu, gap outs %lu, max outs %lu, skips %lu\n\r",
+			copy.extensions, copy.gap_outs, copy.max_outs, copy.skips);
+	fprintf(out, "Demand EW %d NS %d\n\r", copy.demand[APPROACH_EW], copy.demand[APPROACH_NS]);
+}
@@ -0,0 +1,43 @@
+#ifndef ACTUATED_H_
+#define ACTUATED_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Vehicle-actuated green timing (mode 5). A detector event (KEY2) calls for
+// service on a red approach, or extends the green of the approach being
+// served. Each green runs for its minimum, then for as long as vehicles keep
+// arriving within the passage time, up to its maximum. An approach nobody is
+// waiting at is skipped while the other approach has demand.
+
+#define APPROACH_EW 0
+#define APPROACH_NS 1
+#define APPROACHES 2
+
+typedef struct {
+	alt_u32 min_green; // Ticks of green given whenever the approach is served.
+	alt_u32 passage;   // Green is extended while vehicles arrive within this gap.
+	alt_u32 max_green; // Green ends here even when vehicles are still arriving.
+} ActuatedTiming;
+
+typedef struct {
+	ActuatedTiming timing[APPROACHES];
+	alt_u32 last_call[APPROACHES]; // Tick of the last detector event.
+	alt_u8 demand[APPROACHES];     // A vehicle is waiting on red.
+	int green;                     // Approach being served, or -1.
+	alt_u32 green_start;           // Tick the current green started.
+	alt_u32 extensions;            // Times a green was extended past a deadline.
+	alt_u32 gap_outs;              // Greens ended by a gap in the traffic.
+	alt_u32 max_outs;              // Greens ended by reaching their maximum.
+	alt_u32 skips;                 // Greens skipped for lack of demand.
+	alt_u32 detections[APPROACHES]; // Detector events.
+} Actuated;
+
+void actuated_init(Actuated *actuated);
+void actuated_detect(Actuated *actuated, int approach, alt_u32 now);
+int actuated_skip(Actuated *actuated, int approach, int walk_here, int walk_other);
+alt_u32 actuated_green_start(Actuated *actuated, int approach, alt_u32 now);
+alt_u32 actuated_green_extend(Actuated *actuated, alt_u32 now);
+void actuated_report(FILE *out, Actuated *actuated);
+
+#endif /* ACTUATED_H_ */
@@ -0,0 +1,46 @@
+#include "capture.h"
+#include "sys/alt_timestamp.h"
+
+static alt_u32 ticks_per_us = 1;
+
+int capture_init(void) {
+	// Start the timestamp counter running continuously. It wraps instead of stopping,
+	// so captures are valid for any interval shorter than one full period (~85s at 50MHz).
+	if (alt_timestamp_start_continuous() < 0) {
+		return 0;
+	}
+	ticks_per_us = alt_timestamp_freq() / 1000000;
+	if (ticks_per_us == 0) {
+		ticks_per_us = 1;
+	}
+	return 1;
+}
+
+alt_u32 capture_now(void) {
+	return alt_timestamp();
+}
+
+void capture_entry(volatile Capture *capture) {
+	// Record the entry time. Safe to call from an ISR.
+	capture->entry = alt_timestamp();
+	capture->open = 1;
+}
+
+int capture_exit(volatile Capture *capture, alt_u32 *elapsed) {
+	// Close the capture and return the elapsed timer ticks. Returns 0 if no capture was open.
+	alt_u32 now = alt_timestamp();
+	if (!capture->open) {
+		return 0;
+	}
+	*elapsed = now - capture->entry; // Unsigned difference handles the counter wrapping.
+	capture->open = 0;
+	return 1;
+}
+
+void capture_cancel(volatile Capture *capture) {
+	capture->open = 0;
+}
+
+alt_u32 capture_ticks_to_us(alt_u32 ticks) {
+	return ticks / ticks_per_us;
+}
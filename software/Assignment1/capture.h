@@ -0,0 +1,21 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include "alt_types.h"
+
+// Entry / exit time capture using the free running timestamp timer (timer_1).
+// Captures have the resolution of the timer clock and need no interrupts.
+
+typedef struct {
+	alt_u32 entry; // Timestamp count when the capture was opened.
+	int open;      // Set between capture_entry() and capture_exit().
+} Capture;
+
+int capture_init(void);
+void capture_entry(volatile Capture *capture);
+int capture_exit(volatile Capture *capture, alt_u32 *elapsed);
+void capture_cancel(volatile Capture *capture);
+alt_u32 capture_now(void);
+alt_u32 capture_ticks_to_us(alt_u32 ticks);
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,205 @@
+#include <string.h>
+#include "cluster.h"
+#include "capture.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+
+static alt_alarm ClusterTimer;
+static alt_u32 ClusterBenchWrites;
+
+// Bit position of an isolated bit, by de Bruijn multiplication, as in the
+// BSP's interrupt dispatch (alt_irq_handler.c).
+#define CLUSTER_DEBRUIJN 0x077CB531u
+static const alt_u8 cluster_debruijn[32] = {
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
+
+void cluster_init(Cluster *cluster) {
+	memset(cluster, 0, sizeof(*cluster));
+}
+
+int cluster_add(Cluster *cluster, int mode, const alt_u16 *timeouts, alt_u32 start) {
+	// Add an intersection running "mode", entering its first state at tick "start".
+	// Returns its index, or -1 if the cluster is full.
+	int i = cluster->count;
+	int slot;
+
+	if (i >= CLUSTER_MAX) {
+		return -1;
+	}
+	cluster->table[i] = phase_table(mode);
+	cluster->state[i] = 0;
+	cluster->waiting[i] = 0;
+	cluster->signals[i] = 0;
+	cluster->wait[i] = 0;
+	cluster->deadline[i] = start;
+	for (slot = 0; slot < PHASE_STATES; slot++) {
+		cluster->timeout[slot][i] = timeouts[slot];
+	}
+	if (i == 0 || (alt_32) (start - cluster->next) < 0) {
+		cluster->next = start;
+	}
+	cluster->count = i + 1;
+	return i;
+}
+
+void cluster_request_walk(Cluster *cluster, int index, alt_u8 crossing) {
+	// A pedestrian pressed the button for "crossing" (SIG_NS_WALK or SIG_EW_WALK).
+	alt_irq_context context = alt_irq_disable_all();
+	cluster->waiting[index] |= crossing;
+	cluster->wait[index] |= (crossing & SIG_NS_WALK) ? WAIT_NS : WAIT_EW;
+	cluster->dirty[index >> 5] |= 1u << (index & 31);
+	alt_irq_enable_all(context);
+}
+
+static void cluster_step(Cluster *cluster, int i) {
+	// Show intersection i's current state, then move it to the next one.
+	// The same rules as run_phase() in hello_world.c.
+	const PhaseRow *row = &cluster->table[i][cluster->state[i]];
+	alt_u8 walk = row->walk & cluster->waiting[i];
+	alt_u8 next = cluster->state[i] + 1;
+
+	if (row->flags & PHASE_WALK_START) {
+		cluster->wait[i] &= ~row->wait;
+	}
+	cluster->signals[i] = row->signals | walk;
+	if (row->flags & PHASE_WALK_END) {
+		cluster->waiting[i] &= ~walk;
+	}
+	cluster->deadline[i] += cluster->timeout[row->timeout][i];
+	cluster->state[i] = next < PHASE_STATES ? next : 0;
+	cluster->dirty[i >> 5] |= 1u << (i & 31);
+}
+
+int cluster_advance(Cluster *cluster, alt_u32 now) {
+	// Step every intersection whose deadline has been reached, and find the next
+	// deadline. Returns the number of intersections stepped.
+	int i;
+	int stepped = 0;
+	alt_u32 next;
+
+	if ((alt_32) (now - cluster->next) < 0) {
+		return 0; // Nothing due yet.
+	}
+	next = now + 0x7FFFFFFF;
+	for (i = 0; i < cluster->count; i++) {
+		if ((alt_32) (now - cluster->deadline[i]) >= 0) {
+			cluster_step(cluster, i);
+			stepped++;
+		}
+		if ((alt_32) (cluster->deadline[i] - next) < 0) {
+			next = cluster->deadline[i];
+		}
+	}
+	cluster->next = next;
+	return stepped;
+}
+
+void cluster_flush(Cluster *cluster, ClusterWrite write) {
+	// Send the outputs of every intersection that changed. Called from the main loop.
+	int word;
+	alt_u32 bits;
+	alt_irq_context context;
+
+	for (word = 0; word < CLUSTER_DIRTY_WORDS; word++) {
+		context = alt_irq_disable_all();
+		bits = cluster->dirty[word];
+		cluster->dirty[word] = 0;
+		alt_irq_enable_all(context);
+
+		while (bits) {
+			alt_u32 low = bits & -bits;
+			int bit = cluster_debruijn[(low * CLUSTER_DEBRUIJN) >> 27];
+			bits &= ~low;
+			write(word * 32 + bit, cluster->signals[word * 32 + bit], cluster->wait[word * 32 + bit]);
+		}
+	}
+}
+
+static alt_u32 cluster_timer_isr(void* context) {
+	// One alarm for the whole cluster, due at the earliest deadline.
+	// The alarm adds the return value to the tick it was due, not to now.
+	Cluster *cluster = (Cluster*) context;
+	cluster_advance(cluster, alt_nticks());
+	if ((alt_32) (cluster->next - ClusterTimer.time) <= 0) {
+		return 1;
+	}
+	return cluster->next - ClusterTimer.time;
+}
+
+int cluster_start(Cluster *cluster) {
+	// Start stepping the cluster from the system clock.
+	if (cluster->count == 0) {
+		return 0;
+	}
+	return alt_alarm_start_at(&ClusterTimer, cluster->next, cluster_timer_isr, cluster) == 0;
+}
+
+void cluster_stop(void) {
+	alt_alarm_stop(&ClusterTimer);
+}
+
+static void cluster_bench_write(int index, alt_u8 signals, alt_u8 wait) {
+	// Stands in for the I/O expander.
+	ClusterBenchWrites++;
+}
+
+void cluster_bench(FILE *out, const char *args) {
+	// Time the tick path with a full cluster, with every intersection due on every tick,
+	// then the flush of its outputs, then run it from the system clock for a few ticks.
+	static Cluster bench;
+	static const alt_u16 timeouts[PHASE_STATES] = {1, 1, 1, 1, 1, 1};
+	const int rounds = 100;
+	alt_u32 start;
+	alt_u32 ticks;
+	alt_u32 steps = 0;
+	alt_u32 now;
+	int i;
+
+	cluster_init(&bench);
+	for (i = 0; i < CLUSTER_MAX; i++) {
+		cluster_add(&bench, 2 + (i & 1), timeouts, 0);
+	}
+	start = capture_now();
+	for (i = 0; i < rounds; i++) {
+		steps += cluster_advance(&bench, i);
+	}
+	ticks = capture_now() - start;
+
+	fprintf(out, "%lu intersection steps in %lu timer ticks (%lu Hz)\n\r", steps, ticks, alt_timestamp_freq());
+	if (steps) {
+		fprintf(out, "%lu ticks per intersection step\n\r", ticks / steps);
+	}
+
+	for (i = 0; i < CLUSTER_MAX; i++) {
+		cluster_request_walk(&bench, i, (i & 1) ? SIG_EW_WALK : SIG_NS_WALK);
+	}
+	ClusterBenchWrites = 0;
+	start = capture_now();
+	cluster_flush(&bench, cluster_bench_write);
+	ticks = capture_now() - start;
+	fprintf(out, "%lu of %d outputs flushed in %lu timer ticks\n\r", ClusterBenchWrites, CLUSTER_MAX, ticks);
+
+	// Every intersection steps once per system clock tick, so each deadline ends up
+	// the number of ticks it was stepped on past the start.
+	cluster_init(&bench);
+	now = alt_nticks() + 1;
+	for (i = 0; i < CLUSTER_MAX; i++) {
+		cluster_add(&bench, 2 + (i & 1), timeouts, now);
+	}
+	if (!cluster_start(&bench)) {
+		fprintf(out, "Cluster alarm did not start\n\r");
+		return;
+	}
+	while ((alt_32) (alt_nticks() - (now + rounds)) < 0) {
+	}
+	cluster_stop();
+	steps = 0;
+	for (i = 0; i < CLUSTER_MAX; i++) {
+		steps += bench.deadline[i] - now;
+	}
+	fprintf(out, "%lu intersection steps from the alarm over %d system clock ticks (%d per tick expected)\n\r",
+			steps, rounds, CLUSTER_MAX);
+}
@@ -0,0 +1,44 @@
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+#include "phase_table.h"
+
+// Multi-intersection engine. One controller drives a cluster of intersections
+// (through an I/O expander) from a single alarm. The state of each
+// intersection is kept in structure-of-arrays form: a tick walks each field
+// as a dense array, so the deadlines checked on every tick share a few cache
+// lines instead of being spread through one large record per intersection.
+// The controller does not drive a cluster yet. The clusterbench console
+// command runs the whole engine, alarm included, against a stub writer.
+
+#define CLUSTER_MAX 64 // Intersections per cluster.
+#define CLUSTER_DIRTY_WORDS ((CLUSTER_MAX + 31) / 32)
+
+typedef struct {
+	int count;                                    // Intersections in use.
+	alt_u32 next;                                 // Earliest deadline of any intersection.
+	alt_u32 deadline[CLUSTER_MAX];                // Tick of each intersection's next transition.
+	const PhaseRow *table[CLUSTER_MAX];           // Phase table of each intersection's mode.
+	alt_u8 state[CLUSTER_MAX];                    // Current row of the table.
+	alt_u8 waiting[CLUSTER_MAX];                  // Walk requests (SIG_NS_WALK / SIG_EW_WALK).
+	alt_u8 signals[CLUSTER_MAX];                  // Signal outputs, as LEDS_GREEN.
+	alt_u8 wait[CLUSTER_MAX];                     // Wait light outputs, as LEDS_RED.
+	alt_u16 timeout[PHASE_STATES][CLUSTER_MAX];   // Timeout of each state, in ticks.
+	alt_u32 dirty[CLUSTER_DIRTY_WORDS];           // Intersections whose outputs changed.
+} Cluster;
+
+// Writes one intersection's outputs to the I/O expander.
+typedef void (*ClusterWrite)(int index, alt_u8 signals, alt_u8 wait);
+
+void cluster_init(Cluster *cluster);
+int cluster_add(Cluster *cluster, int mode, const alt_u16 *timeouts, alt_u32 start);
+void cluster_request_walk(Cluster *cluster, int index, alt_u8 crossing);
+int cluster_advance(Cluster *cluster, alt_u32 now);
+void cluster_flush(Cluster *cluster, ClusterWrite write);
+int cluster_start(Cluster *cluster);
+void cluster_stop(void);
+void cluster_bench(FILE *out, const char *args);
+
+#endif /* CLUSTER_H_ */
@@ -0,0 +1,134 @@
+#include <string.h>
+#include "console.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_timestamp.h"
+#include "sys/alt_irq_profile.h"
+
+typedef struct {
+	const char *name;
+	ConsoleCommand run;
+} ConsoleEntry;
+
+static void irqstat_command(FILE *out, const char *args);
+static void irqclear_command(FILE *out, const char *args);
+static void help_command(FILE *out, const char *args);
+
+static ConsoleEntry commands[CONSOLE_MAX_COMMANDS];
+static unsigned int number_of_commands = 0;
+
+static FILE *console_out;
+static char line[CONSOLE_LINE_LENGTH];
+
+void console_init(FILE *out) {
+	console_out = out;
+	number_of_commands = 0;
+	console_add("help", help_command);
+	console_add("irqstat", irqstat_command);
+	console_add("irqclear", irqclear_command);
+}
+
+int console_add(const char *name, ConsoleCommand run) {
+	// Register a command. Returns 0 if the table is full.
+	if (number_of_commands >= CONSOLE_MAX_COMMANDS) {
+		return 0;
+	}
+	commands[number_of_commands].name = name;
+	commands[number_of_commands].run = run;
+	number_of_commands++;
+	return 1;
+}
+
+void console_input(const char *input) {
+	unsigned int i;
+	char *args;
+
+	if (*input == '\0') {
+		return;
+	}
+	strncpy(line, input, CONSOLE_LINE_LENGTH - 1);
+	line[CONSOLE_LINE_LENGTH - 1] = '\0';
+
+	// The command name ends at the first space. The rest of the line is its arguments.
+	args = strchr(line, ' ');
+	if (args != NULL) {
+		*args++ = '\0';
+		while (*args == ' ') {
+			args++;
+		}
+	} else {
+		args = line + strlen(line);
+	}
+	for (i = 0; i < number_of_commands; i++) {
+		if (strcmp(line, commands[i].name) == 0) {
+			commands[i].run(console_out, args);
+			return;
+		}
+	}
+	fprintf(console_out, "Unknown command: %s\n\r", line);
+}
+
+static void help_command(FILE *out, const char *args) {
+	unsigned int i;
+
+	for (i = 0; i < number_of_commands; i++) {
+		fprintf(out, "%s\n\r", commands[i].name);
+	}
+}
+
+#ifdef ALT_IRQ_PROFILE
+
+static void print_histogram(FILE *out, const char *name, const alt_u32 *buckets) {
+	// Bucket n holds times in [2^(n-1), 2^n) timestamp ticks. Only non-empty
+	// buckets are printed, as lower bound:count.
+	int n;
+
+	fprintf(out, "  %s:", name);
+	for (n = 0; n < ALT_IRQ_PROFILE_BUCKETS; n++) {
+		if (buckets[n]) {
+			fprintf(out, " %lu:%lu", n ? 1UL << (n - 1) : 0UL, buckets[n]);
+		}
+	}
+	fprintf(out, "\n\r");
+}
+
+static void irqstat_command(FILE *out, const char *args) {
+	// Copy each entry with interrupts disabled so the dump is consistent.
+	alt_irq_profile_t profile;
+	alt_irq_context context;
+	int id;
+
+	fprintf(out, "IRQ profile, %lu ticks per second\n\r", alt_timestamp_freq());
+	for (id = 0; id < ALT_NIRQ; id++) {
+		context = alt_irq_disable_all();
+		profile = alt_irq_profile[id];
+		alt_irq_enable_all(context);
+
+		if (profile.count == 0) {
+			continue;
+		}
+		fprintf(out, "IRQ %d: count %lu, exec max %lu, interval min %lu\n\r",
+				id, profile.count, profile.exec_max, profile.interval_min);
+		fprintf(out, "  dispatch max %lu, mean %lu\n\r",
+				profile.dispatch_max, profile.dispatch_total / profile.count);
+		print_histogram(out, "exec", profile.exec);
+		print_histogram(out, "interval", profile.interval);
+	}
+}
+
+static void irqclear_command(FILE *out, const char *args) {
+	alt_irq_profile_clear();
+	fprintf(out, "IRQ profile cleared\n\r");
+}
+
+#else
+
+static void irqstat_command(FILE *out, const char *args) {
+	fprintf(out, "IRQ profiling is not compiled in (ALT_IRQ_PROFILE)\n\r");
+}
+
+static void irqclear_command(FILE *out, const char *args) {
+	irqstat_command(out, args);
+}
+
+#endif /* ALT_IRQ_PROFILE */
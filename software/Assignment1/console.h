@@ -0,0 +1,20 @@
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include <stdio.h>
+
+// Line based command console on the uart. Lines are fed in from the main
+// loop while switch 17 is low, and each one is looked up in a table of
+// commands. Modules add their own commands with console_add(). Anything
+// after the command name is passed to the command as its arguments.
+
+#define CONSOLE_LINE_LENGTH 32
+#define CONSOLE_MAX_COMMANDS 24
+
+typedef void (*ConsoleCommand)(FILE *out, const char *args);
+
+void console_init(FILE *out);
+int console_add(const char *name, ConsoleCommand run);
+void console_input(const char *input);
+
+#endif /* CONSOLE_H_ */
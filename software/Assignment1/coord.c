@@ -0,0 +1,99 @@
+#include "coord.h"
+#include "sys/alt_irq.h"
+
+void coord_init(Coord *coord) {
+	coord->enabled = 0;
+	coord->epoch = 0;
+	coord->cycle = 0;
+	coord->offset = 0;
+	coord->in_step = 0;
+	coord->cycles = 0;
+	coord->corrections = 0;
+}
+
+int coord_set(Coord *coord, alt_u32 cycle, alt_u32 offset, alt_u32 fixed) {
+	// Coordinate on "cycle" with the coordinated green "offset" ticks into it.
+	// "fixed" is the length of every state but the side green. Returns 0 if the
+	// cycle leaves no room for the minimum side green.
+	alt_irq_context context;
+
+	if (cycle < fixed + COORD_MIN_GREEN) {
+		return 0;
+	}
+	context = alt_irq_disable_all();
+	coord->cycle = cycle;
+	coord->offset = offset % cycle;
+	coord->in_step = 0;
+	coord->enabled = 1;
+	alt_irq_enable_all(context);
+	return 1;
+}
+
+void coord_stop(Coord *coord) {
+	coord->enabled = 0;
+}
+
+void coord_sync(Coord *coord, alt_u32 now) {
+	// The corridor's cycles start now.
+	alt_irq_context context = alt_irq_disable_all();
+	coord->epoch = now;
+	coord->in_step = 0;
+	alt_irq_enable_all(context);
+}
+
+alt_u32 coord_side_green(Coord *coord, alt_u32 start, alt_u32 clearance, alt_u32 fixed, alt_u32 planned) {
+	// Called from the alarm callback as the side green starts at tick "start". It
+	// is followed by "clearance" ticks of yellow and all red, then the coordinated
+	// green. "fixed" is the length of every other state. Returns the side green
+	// length that starts the coordinated green on the next offset it can reach,
+	// or "planned" when not coordinating.
+	alt_u32 earliest;
+	alt_32 since;
+	alt_u32 late;
+	alt_u32 target;
+	alt_u32 green;
+	alt_u32 longest;
+
+	if (!coord->enabled) {
+		return planned;
+	}
+	// Position of the earliest possible coordinated green in the cycle.
+	earliest = start + COORD_MIN_GREEN + clearance;
+	since = (alt_32) (earliest - (coord->epoch + coord->offset));
+	if (since >= 0) {
+		late = (alt_u32) since % coord->cycle;
+	} else {
+		late = coord->cycle - (alt_u32) -since % coord->cycle;
+	}
+	target = late ? earliest + (coord->cycle - late) : earliest;
+	green = target - start - clearance;
+
+	// Move into step gradually rather than giving one very long side green. In
+	// step, the side green is whatever the cycle leaves over.
+	longest = coord->cycle - fixed + coord->cycle / COORD_STEP_DIVISOR;
+	coord->cycles++;
+	if (green > longest) {
+		green = longest;
+		coord->in_step = 0;
+		coord->corrections++;
+	} else {
+		coord->in_step = 1;
+	}
+	return green;
+}
+
+void coord_report(FILE *out, Coord *coord) {
+	// Copy with interrupts disabled, since the alarm callback updates it.
+	Coord copy;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *coord;
+	alt_irq_enable_all(context);
+
+	if (!copy.enabled) {
+		fprintf(out, "Not coordinating\n\r");
+		return;
+	}
+	fprintf(out, "Cycle %lu offset %lu ticks, epoch %lu, %s\n\r",
+			copy.cycle, copy.offset, copy.epoch, copy.in_step ? "in step" : "moving into step");
+	fprintf(out, "Side greens %lu, limited %lu\n\r", copy.cycles, copy.corrections);
+}
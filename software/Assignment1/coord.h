@@ -0,0 +1,37 @@
+#ifndef COORD_H_
+#define COORD_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Green wave coordination along a corridor. Every controller on the arterial
+// runs the same cycle length, counted from a shared epoch, and starts its
+// coordinated (NS) green a fixed offset into each cycle. Offsets that follow
+// the travel time between intersections give a platoon consecutive greens.
+//
+// The epoch is shared by sending "sync" to every controller at the same time.
+// The side street (EW) green absorbs the difference between the cycle length
+// and the other states, and moves the controller into step over a few cycles
+// after a change, rather than holding it in all red.
+
+#define COORD_MIN_GREEN 3000 // Shortest side street green, in ticks.
+#define COORD_STEP_DIVISOR 5 // A side green runs at most cycle / 5 over its length in step.
+
+typedef struct {
+	int enabled;
+	alt_u32 epoch;        // Tick the corridor's cycles are counted from.
+	alt_u32 cycle;        // Common cycle length, in ticks.
+	alt_u32 offset;       // Ticks into each cycle that the coordinated green starts.
+	int in_step;          // The next coordinated green starts on its offset.
+	alt_u32 cycles;       // Side greens timed while coordinating.
+	alt_u32 corrections;  // Side greens limited while moving into step.
+} Coord;
+
+void coord_init(Coord *coord);
+int coord_set(Coord *coord, alt_u32 cycle, alt_u32 offset, alt_u32 fixed);
+void coord_stop(Coord *coord);
+void coord_sync(Coord *coord, alt_u32 now);
+alt_u32 coord_side_green(Coord *coord, alt_u32 start, alt_u32 clearance, alt_u32 fixed, alt_u32 planned);
+void coord_report(FILE *out, Coord *coord);
+
+#endif /* COORD_H_ */
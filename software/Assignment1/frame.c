@@ -0,0 +1,113 @@
+#include "frame.h"
+
+// CRC-16/CCITT a nibble at a time. The 16 entry table is small enough to keep
+// in the data cache, and needs half the loop passes of the bitwise version.
+static const alt_u16 crc_nibble[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+alt_u16 frame_crc16(const alt_u8 *data, int length) {
+	alt_u16 crc = 0xffff;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		crc = (crc << 4) ^ crc_nibble[((crc >> 12) ^ (data[i] >> 4)) & 0x0f];
+		crc = (crc << 4) ^ crc_nibble[((crc >> 12) ^ data[i]) & 0x0f];
+	}
+	return crc;
+}
+
+int frame_encode(alt_u8 *frame, const alt_u8 *message, int length) {
+	// Append the CRC, COBS encode, and add the zeros at each end. "frame" must
+	// hold FRAME_MAX_ENCODED bytes. Returns the bytes to send, or 0 if the
+	// message is too long.
+	alt_u8 body[FRAME_MAX_MESSAGE + 2];
+	alt_u16 crc;
+	int code_at;
+	int out;
+	int i;
+
+	if (length < 2 || length > FRAME_MAX_MESSAGE) {
+		return 0;
+	}
+	for (i = 0; i < length; i++) {
+		body[i] = message[i];
+	}
+	crc = frame_crc16(message, length);
+	frame_put16(&body[length], crc);
+	length += 2;
+
+	// Each zero is replaced by the distance to the next one, held in the code
+	// byte that starts its block.
+	frame[0] = 0;
+	code_at = 1;
+	out = 2;
+	for (i = 0; i < length; i++) {
+		if (body[i] == 0) {
+			frame[code_at] = out - code_at;
+			code_at = out++;
+		} else {
+			frame[out++] = body[i];
+			if (out - code_at == 0xff) {
+				frame[code_at] = 0xff;
+				code_at = out++;
+			}
+		}
+	}
+	frame[code_at] = out - code_at;
+	frame[out++] = 0;
+	return out;
+}
+
+int frame_decode(alt_u8 *message, const alt_u8 *body, int length) {
+	// Undo the COBS encoding of the bytes between the zeros and check the CRC.
+	// "message" must hold FRAME_MAX_MESSAGE + 2 bytes. Returns the length of the
+	// message without its CRC, or -1 if the frame is damaged.
+	int in = 0;
+	int out = 0;
+	int block;
+	int code;
+
+	while (in < length) {
+		block = body[in++];
+		code = block;
+		if (code == 0 || in + code - 1 > length || out + code - 1 > FRAME_MAX_MESSAGE + 2) {
+			return -1;
+		}
+		while (--code > 0) {
+			message[out++] = body[in++];
+		}
+		// Each block but the last, and those of 254 bytes, ended at a zero.
+		if (block < 0xff && in < length) {
+			if (out >= FRAME_MAX_MESSAGE + 2) {
+				return -1;
+			}
+			message[out++] = 0;
+		}
+	}
+	if (out < 4 || frame_crc16(message, out - 2) != frame_get16(&message[out - 2])) {
+		return -1;
+	}
+	return out - 2;
+}
+
+void frame_put16(alt_u8 *data, alt_u16 value) {
+	data[0] = value;
+	data[1] = value >> 8;
+}
+
+void frame_put32(alt_u8 *data, alt_u32 value) {
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+	data[3] = value >> 24;
+}
+
+alt_u16 frame_get16(const alt_u8 *data) {
+	return data[0] | (data[1] << 8);
+}
+
+alt_u32 frame_get32(const alt_u8 *data) {
+	return data[0] | (data[1] << 8) | ((alt_u32) data[2] << 16) | ((alt_u32) data[3] << 24);
+}
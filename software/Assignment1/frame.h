@@ -0,0 +1,68 @@
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "alt_types.h"
+
+// Binary message framing for the uart, shared with the host library
+// (../host/tlcproto.h). A message is a type byte, a sequence number and a
+// payload. It is sent with a CRC-16 (CCITT, 0x1021, initial value 0xffff)
+// appended, COBS encoded so that it contains no zero bytes, and wrapped in a
+// zero byte at each end:
+//
+//     00 | COBS(type, sequence, payload, crc low, crc high) | 00
+//
+// The uart driver returns everything from the first zero up to the second as
+// one record, so binary frames and console lines can share the port. Both
+// zeros are always sent, even between back to back frames.
+//
+// Every request is answered with a reply of the same type with FRAME_REPLY
+// set, the same sequence number, and a status byte before its data. Multi
+// byte values are little endian. This file has no dependencies on the HAL,
+// so it builds for the host as well.
+
+#define FRAME_MAX_MESSAGE 60 // Type, sequence and payload.
+#define FRAME_MAX_ENCODED (FRAME_MAX_MESSAGE + 5) // With the CRC, the COBS code byte and both zeros.
+
+// Message types.
+#define FRAME_TIMING 1   // Upload t0..t5: flash u8, six u16 timeouts in ms.
+#define FRAME_PLAN 2     // Upload a plan: index u8, start minute u16, flash u8, six u16 timeouts.
+#define FRAME_MODE 3     // Change mode: mode u8, 1..5, or 0 to follow the switches.
+#define FRAME_COUNTERS 4 // Read the counters: the reply holds FRAME_COUNTER_VALUES u32s.
+#define FRAME_LOG 5      // Read an event log: log u8. The reply holds a count u8 and the entries, oldest first.
+#define FRAME_TELEMETRY 6 // Set the telemetry rate: Hz u8, 0 for off. Records (telemetry.h) are sent
+                          // with this type, without FRAME_REPLY, and numbered by their sequence byte.
+#define FRAME_REPLY 0x80
+
+// Reply status.
+#define FRAME_OK 0
+#define FRAME_BAD_LENGTH 1
+#define FRAME_BAD_VALUE 2
+#define FRAME_UNKNOWN 3
+
+// Counters, in reply order.
+#define FRAME_COUNT_SWAPS 0           // Timing sets swapped in.
+#define FRAME_COUNT_PED_SERVED 1
+#define FRAME_COUNT_PED_WAIT_MAX 2    // ms.
+#define FRAME_COUNT_PREEMPTS 3
+#define FRAME_COUNT_PREEMPT_LATENCY 4 // Worst, in ms.
+#define FRAME_COUNT_TSP_EXTENDED 5
+#define FRAME_COUNT_TSP_EARLY 6
+#define FRAME_COUNT_PLAN_CHANGES 7
+#define FRAME_COUNT_FRAMES 8          // Frames received intact.
+#define FRAME_COUNT_FRAME_ERRORS 9    // Frames that failed their CRC or were malformed.
+#define FRAME_COUNTER_VALUES 10
+
+// Event logs.
+#define FRAME_LOG_PREEMPT 0 // Entries of approach u8, latency u32 in ms.
+#define FRAME_LOG_TSP 1     // Entries of approach u8, outcome u8, delay saved u32 in ms.
+
+alt_u16 frame_crc16(const alt_u8 *data, int length);
+int frame_encode(alt_u8 *frame, const alt_u8 *message, int length);
+int frame_decode(alt_u8 *message, const alt_u8 *body, int length);
+
+void frame_put16(alt_u8 *data, alt_u16 value);
+void frame_put32(alt_u8 *data, alt_u32 value);
+alt_u16 frame_get16(const alt_u8 *data);
+alt_u32 frame_get32(const alt_u8 *data);
+
+#endif /* FRAME_H_ */
@@ -1,71 +1,154 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sys/ioctl.h"
 #include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
 #include <system.h>
 #include <altera_avalon_pio_regs.h>
+#include <altera_avalon_uart.h>
+#include "capture.h"
+#include "workq.h"
+#include "console.h"
+#include "phase.h"
+#include "phase_table.h"
+#include "cluster.h"
+#include "actuated.h"
+#include "coord.h"
+#include "plan.h"
+#include "timing.h"
+#include "pedwait.h"
+#include "preempt.h"
+#include "tsp.h"
+#include "proto.h"
+#include "parse.h"
+#include "telemetry.h"
+#include "tlog.h"
 
 // #Defines
 #define LIGHT_TRANSITION_TIME 1000
 #define CAMERA_TIMEOUT 2000
-#define INTERSECTION_TIMEOUT 1
 #define NEW_TIMEOUT_LENGTH 40
+#define UART_LINE_LENGTH 64 // Longest record the uart driver returns (ALT_AVALON_UART_LINE_LEN).
 #define NUMBER_OF_TIMEOUT_VALUES 6
+#define FLASH_INTERVAL 500
 
 // ENUMS
-enum OpperationMode {Mode1 = 1, Mode2 = 2, Mode3 = 3, Mode4 = 4};
+enum OpperationMode {Mode1 = 1, Mode2 = 2, Mode3 = 3, Mode4 = 4, Mode5 = 5};
 
 // Function declarations
 void UpdateMode(enum OpperationMode *currentMode);
 void lcd_set_mode(enum OpperationMode currentMode);
-void simple_tlc();
-void pedestrian_tlc(void);
+void run_phase(enum OpperationMode mode);
+void actuated_select(void);
+void actuated_time_green(void);
+void use_timing(const TimingSet *set);
+void load_timing(const alt_u32 *timeouts, int flash);
+alt_u32 flash_step(void);
 void init_buttons_pio(void* context);
+void ped_bound_wait(int crossing, void* context);
+alt_u32 ped_bound_end(int crossing, const PhaseRow *table, int green, alt_u32 start);
+int end_state_at(alt_u32 end, void* context);
+int extend_state_to(alt_u32 end, void* context);
+void tsp_view(const PhaseRow *table, int approach, int shown, alt_u32 start, alt_u32 end, TspView *view);
+void preempt_poll(unsigned int switches, void* context);
+void tsp_poll(unsigned int switches, void* context);
+int green_state(const PhaseRow *table, alt_u8 green);
+alt_u32 preempt_step(enum OpperationMode *currentMode);
+alt_u32 preempt_bound(void);
 void NSEW_ped_isr(void* context, alt_u32 id);
-void configurable_tlc(enum OpperationMode *currentMode);
 void timeout_data_handler(enum OpperationMode *currentMode);
 void ResetAllStates(void);
 int InSafeState (void);
-int ParseNewTimeout(char *New_Timeout, int New_Timeout_Index);
+int ParseNewTimeout(const char *line, int length);
 void nextState(enum OpperationMode *currentMode);
-void camera_tlc(enum OpperationMode *currentMode);
 void handle_vehicle_button(enum OpperationMode *currentMode);
 void takeSnapshot(void);
-void handle_intersection_timer();
+void report_vehicle_left(void);
+// Deferred work, run from the main loop.
+void lcd_mode_work(alt_u32 mode);
+void vehicle_left_convert(alt_u32 *args);
+void phase_command(FILE *out, const char *args);
+void actuated_command(FILE *out, const char *args);
+void coord_command(FILE *out, const char *args);
+void sync_command(FILE *out, const char *args);
+void plans_command(FILE *out, const char *args);
+void time_command(FILE *out, const char *args);
+void plan_work(alt_u32 unused);
+void timing_command(FILE *out, const char *args);
+void pedwait_command(FILE *out, const char *args);
+void preempt_command(FILE *out, const char *args);
+void tsp_command(FILE *out, const char *args);
+void log_preemption(void);
+void preempt_convert(alt_u32 *args);
+void proto_command(FILE *out, const char *args);
+int timing_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+int plan_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+int mode_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+int counters_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+int log_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+int telemetry_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+void telemetry_command(FILE *out, const char *args);
+void telemetry_sample(TelemetrySample *sample, void *context);
+void uart_command(FILE *out, const char *args);
+FILE *lcd_open(void);
+void lcd_status_work(alt_u32 unused);
+alt_u32 status_timer_isr(void* context);
+alt_u32 cycle_length(void);
 // ISR's
 alt_u32 camera_timer_isr(void* context, alt_u32 id);
-alt_u32 in_intersection_timer_isr(void* context, alt_u32 id);
 alt_u32 tlc_timer_isr(void* context);
+alt_u32 switch_poll_isr(void* context);
 
 
 // Global variables
 volatile alt_alarm timer; //Timer for main logic
 volatile alt_alarm CameraTimer; // Timer for timer timeout.
-volatile alt_alarm TimerInIntersection; // Keep track of how long a car was in intersection.
+alt_alarm StatusTimer; // Refreshes the lcd status line.
+alt_alarm SwitchTimer; // Polls the preemption and transit priority switches.
+volatile Capture InIntersection; // Timestamps of a car entering the intersection.
+PhaseClock Phase; // Absolute deadlines for the state transitions.
+Actuated Actuation; // Detector driven green timing for mode 5.
+Coord Coordination; // Green wave cycle and offset, set from the console.
+PlanSchedule Plans; // Time of day timing plans.
 
 // ISR Flags
 volatile int camera_has_started = 0;
 volatile int even_button = 0;
 volatile int timer_has_started = 0;
-volatile int time_in_intersection = 0;
 
 volatile int CurrentState = 0; // Current state for fsm.
-volatile int timer_running = 0; // To prevent starting / scoping a timer twice.
+volatile int Flashing = 0; // The night plan is flashing the lights instead of cycling.
+volatile int FlashOn = 0;
 
 // Global timeoutt values.
-volatile int t0 = 500;
-volatile int t1 = 6000;
-volatile int t2 = 2000;
-volatile int t3 = 500;
-volatile int t4 = 6000;
-volatile int t5 = 2000;
+const alt_u32 DefaultTimeouts[NUMBER_OF_TIMEOUT_VALUES] = {500, 6000, 2000, 500, 6000, 2000}; // t0..t5
+Timing Timings; // Active t0..t5, and the back buffer new values are written to.
+PedWait Pedestrians; // Pedestrian wait times and the max wait policy.
+Preempt Preemption; // Emergency vehicle call and latency log.
+Tsp Transit; // Transit signal priority requests and outcomes.
+Proto Protocol; // Binary requests on the uart.
+Telemetry Stream; // Periodic state records on the uart.
+
+// Uart log messages, by id (tlog.h). Recorded from the ISRs and formatted in the main loop.
+enum LogMessage {LOG_CAMERA_ON, LOG_SNAPSHOT, LOG_VEHICLE_LEFT, LOG_PREEMPTED};
+const TlogMessage LogMessages[] = {
+	{"Camera activated \n\r", 0},
+	{"Snapshot taken \n\r", 0},
+	{"Vehicle left after %lu.%03lu milliseconds \n\r", vehicle_left_convert}, // Ticks.
+	{"Preempted to %s green in %lu ms\n\r", preempt_convert},                 // Approach, latency in ticks.
+};
+volatile enum OpperationMode RemoteMode = 0; // Mode set over the uart, used while no mode switch is up. 0 for none.
 volatile int currentTimeOut = 6000;
 // Pedestrian flags
 volatile int EW_Ped = 0;
 volatile int NS_Ped = 0;
-volatile char New_Timeout[NEW_TIMEOUT_LENGTH];
+volatile char UartLine[UART_LINE_LENGTH + 1];
 // Uart
 volatile FILE* fp;
-volatile char letter;
+int uart_rx; // Non-blocking descriptor for reading the uart, so the main loop can run deferred work.
 volatile int recieve_new_data = 0; // Indicates the status of switch 17. (Indicates receiving new timeout values).
 
 
@@ -74,56 +157,75 @@ int main() {
 	enum OpperationMode currentMode = Mode1;
 	lcd_set_mode(currentMode); // Display starting mode.
 	void* CurrentModeContex = (void*) &currentMode;
-	alt_alarm_start(&timer, currentTimeOut, tlc_timer_isr, CurrentModeContex); //Start the main loop timer
-	timer_running = 1;
+	capture_init(); // Free running timestamp for measuring how long cars are in the intersection.
+	timing_init(&Timings, DefaultTimeouts);
+	pedwait_init(&Pedestrians);
+	preempt_init(&Preemption);
+	tsp_init(&Transit);
+	actuated_init(&Actuation);
+	coord_init(&Coordination);
+	plan_init(&Plans);
+	//Start the main loop timer, with the plan anchored to now.
+	alt_alarm_start_at(&timer, phase_start(&Phase, currentTimeOut), tlc_timer_isr, CurrentModeContex);
 	init_buttons_pio(CurrentModeContex);
 	fp = fopen(UART_NAME, "r+");
+	uart_rx = open(UART_NAME, O_RDONLY | O_NONBLOCK);
+	console_init((FILE*) fp);
+	tlog_init(LogMessages, sizeof(LogMessages) / sizeof(LogMessages[0]));
+	console_add("phase", phase_command);
+	console_add("clusterbench", cluster_bench);
+	console_add("actuated", actuated_command);
+	console_add("coord", coord_command);
+	console_add("sync", sync_command);
+	console_add("plans", plans_command);
+	console_add("time", time_command);
+	console_add("timing", timing_command);
+	console_add("pedwait", pedwait_command);
+	console_add("preempt", preempt_command);
+	console_add("tsp", tsp_command);
+	console_add("proto", proto_command);
+	console_add("parsebench", parse_bench);
+	console_add("telemetry", telemetry_command);
+	console_add("uart", uart_command);
+	telemetry_init(&Stream, telemetry_sample, CurrentModeContex);
+	proto_init(&Protocol);
+	proto_add(&Protocol, FRAME_TIMING, timing_request);
+	proto_add(&Protocol, FRAME_PLAN, plan_request);
+	proto_add(&Protocol, FRAME_MODE, mode_request);
+	proto_add(&Protocol, FRAME_COUNTERS, counters_request);
+	proto_add(&Protocol, FRAME_LOG, log_request);
+	proto_add(&Protocol, FRAME_TELEMETRY, telemetry_request);
+	alt_alarm_start(&StatusTimer, alt_ticks_per_second(), status_timer_isr, NULL);
+	alt_alarm_start(&SwitchTimer, PREEMPT_POLL, switch_poll_isr, CurrentModeContex);
 	ResetAllStates();
-	int New_Timeout_Index = 0;
-	int valid_new_timeout = 0;
+	int length;
 
 	while(1){
-	// Block until a new value is received via UART. This will get interrupted by the main loop timer to update states.
-		letter = fgetc(fp);
+		// Run any work deferred by the ISRs, then check the UART for a new line.
+		// The uart driver frames the input, so each read returns one whole line,
+		// or a binary frame starting with its zero byte.
+		workq_drain();
+		tlog_drain((FILE*) fp);
+		telemetry_drain(&Stream, (FILE*) fp);
+		length = read(uart_rx, (char*) UartLine, UART_LINE_LENGTH);
+		if (length <= 0) {
+			continue;
+		}
+		if (UartLine[0] == '\0') {
+			proto_input(&Protocol, (FILE*) fp, (const alt_u8*) &UartLine[1], length - 1);
+			continue;
+		}
+		if (length >= NEW_TIMEOUT_LENGTH) { // Too long to be six values.
+			fprintf(fp, "Input too long\n\r");
+			continue;
+		}
+		UartLine[length] = '\0';
 		if (recieve_new_data == 1) {
-			if (!valid_new_timeout){ //Keep receiving timeout updates until a valid sequence is received.
-				//Keep retrieving new values until the \n or \r value is received. Then try to parse this input.
-				if(letter != '\r' && letter != '\n' && letter != '\n\r'){
-					if (New_Timeout_Index >= NEW_TIMEOUT_LENGTH){ // Prevent index out of bounds.
-						New_Timeout_Index = 0;
-						memset(New_Timeout, 0, sizeof(New_Timeout));
-						break; //Got too many characters without a \n to be valid.
-					}
-
-					New_Timeout[New_Timeout_Index] = letter;
-					New_Timeout_Index++;
-					fprintf(fp, "New input: %s\n\r", New_Timeout);
-
-				} else {
-					// A \n or \r was received. Attempt to parse the input.
-					printf("input to parse: %s\n\r", New_Timeout);
-					valid_new_timeout = ParseNewTimeout(&New_Timeout, New_Timeout_Index);
-					if (!valid_new_timeout){
-						fprintf(fp, "Invalid input\n\r");
-					}
-					// Reset the timeout buffer.
-					New_Timeout_Index = 0;
-					memset(New_Timeout, 0, sizeof(New_Timeout));
-				}
-			} else {
-				// Has received a valid input and updated global timeout values.
-				//printf("Received new values. Restarting the timer\n");
-				fprintf(fp, "Received. Unblocking\n\r");
-				timeout_data_handler(&currentMode);
-				if (recieve_new_data == 0){ // If switch 17 has been toggled low, Restart the timer (stop blocking)
-					alt_alarm_start(&timer, currentTimeOut, tlc_timer_isr, CurrentModeContex);
-					timer_running = 1;
-				}
-				else {
-					printf("Switch still high, receiving new timeouts");
-					valid_new_timeout = 0;
-				}
-			}
+			// Traffic keeps running, and valid values are swapped in at the next safe state.
+			fprintf(fp, "New input: %s\n\r", UartLine);
+			ParseNewTimeout((const char*) UartLine, length);
+		} else {
+			console_input((const char*) UartLine); // Not receiving timeouts, so treat the line as a console command.
 		}
 	}
 	return 0;
@@ -134,27 +236,377 @@ alt_u32 tlc_timer_isr(void* context) {
 	enum OpperationMode *currentMode = (unsigned int*) context;
 	UpdateMode(currentMode);
 	timeout_data_handler(currentMode);
-	// Call tick function, then update the current state to next state.
-	switch ((*currentMode)) {
-	case Mode1:
-		simple_tlc();
-		nextState(currentMode);
-		break;
-	case Mode2:
-		pedestrian_tlc();
-		nextState(currentMode);
-		break;
-	case Mode3:
-		configurable_tlc(currentMode);
-		nextState(currentMode);
-		break;
-	case Mode4:
-		camera_tlc(currentMode);
-		nextState(currentMode);
-		break;
+	if (InSafeState() || Flashing) {
+		// Swap in newly published timeouts, if any. The cycle carries on with the new values.
+		const TimingSet *set = timing_swap(&Timings);
+		if (set != NULL) {
+			use_timing(set);
+		}
+	}
+	if (Flashing) {
+		return phase_transition(&Phase, flash_step());
+	}
+	if (Preemption.call >= 0) {
+		return phase_transition(&Phase, preempt_step(currentMode));
+	}
+	if (*currentMode == Mode5) {
+		// Hold the green while vehicles keep arriving within the passage time.
+		alt_u32 extend = actuated_green_extend(&Actuation, alt_nticks());
+		if (extend) {
+			return phase_transition(&Phase, extend);
+		}
+		actuated_select();
+	}
+	// Show the current state from the mode's phase table, then update the current state to next state.
+	// Modes 3 to 5 share mode 2's table. Their additional functionality is handled with interrupts.
+	run_phase(*currentMode);
+	if (*currentMode == Mode5) {
+		actuated_time_green();
+	} else if (phase_table(*currentMode)[CurrentState].signals & SIG_EW_GREEN) {
+		// The side street green puts the next coordinated green on its offset. Phase.deadline
+		// is still the planned start of this state.
+		const alt_u32 *timeouts = Timings.active->timeouts;
+		currentTimeOut = coord_side_green(&Coordination, Phase.deadline, timeouts[5] + timeouts[0],
+				cycle_length() - timeouts[4], currentTimeOut);
+	}
+	if (*currentMode != Mode5 && (phase_table(*currentMode)[CurrentState].signals & (SIG_NS_GREEN | SIG_EW_GREEN))) {
+		// A bus held over on the other approach may end this green early.
+		const PhaseRow *table = phase_table(*currentMode);
+		int other = (table[CurrentState].signals & SIG_NS_GREEN) ? APPROACH_EW : APPROACH_NS;
+		TspView view;
+		alt_u32 end;
+		tsp_view(table, other, CurrentState, Phase.deadline, Phase.deadline + currentTimeOut, &view);
+		end = tsp_conflict_start(&Transit, other, &view);
+		if (end) {
+			currentTimeOut = end - Phase.deadline;
+		}
+		// A pedestrian request made before this green started is bounded by the max wait here.
+		other = (table[CurrentState].signals & SIG_NS_GREEN) ? PED_EW : PED_NS;
+		if (Pedestrians.max_wait != 0 && Pedestrians.waiting[other]) {
+			end = ped_bound_end(other, table, CurrentState, Phase.deadline);
+			if ((alt_32) (end - (Phase.deadline + currentTimeOut)) < 0) {
+				currentTimeOut = end - Phase.deadline;
+				Pedestrians.shortened++;
+			}
+		}
+	}
+	nextState(currentMode);
+
+	workq_post(lcd_status_work, 0);
+	// Plan the next transition against the cycle epoch, not the time this one ran.
+	return phase_transition(&Phase, currentTimeOut);
+}
+
+alt_u32 cycle_length(void) {
+	int i;
+	alt_u32 length = 0;
+	const alt_u32 *timeouts = Timings.active->timeouts;
+	for (i = 0; i < NUMBER_OF_TIMEOUT_VALUES; i++) {
+		length += timeouts[i];
+	}
+	return length;
+}
+
+void phase_command(FILE *out, const char *args) {
+	phase_report(out, &Phase);
+}
+
+void use_timing(const TimingSet *set) {
+	// A new timing set has been swapped in. Called from the alarm callback in a safe state.
+	if (Flashing && !set->flash) {
+		CurrentState = 0; // Leave flash through red-red.
+	}
+	Flashing = set->flash;
+	workq_post(lcd_status_work, 0);
+}
+
+void load_timing(const alt_u32 *timeouts, int flash) {
+	// Write new timeouts into the back buffer and publish them. Not to be called from an ISR.
+	TimingSet *set = timing_back(&Timings);
+	memcpy(set->timeouts, timeouts, sizeof(set->timeouts));
+	set->flash = flash;
+	timing_publish(&Timings, set);
+}
+
+alt_u32 flash_step(void) {
+	// Night flash. NS flashes yellow and EW flashes red. Returns the time to the next step.
+	FlashOn = !FlashOn;
+	IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, FlashOn ? (SIG_NS_YELLOW | SIG_EW_RED) : 0);
+	return FLASH_INTERVAL;
+}
+
+void actuated_command(FILE *out, const char *args) {
+	actuated_report(out, &Actuation);
+}
+
+void coord_command(FILE *out, const char *args) {
+	// "coord <cycle> <offset>" (ms) coordinates, "coord off" stops and "coord" shows the status.
+	// Not used in mode 5, where the greens follow the traffic instead.
+	char *end;
+	alt_u32 cycle;
+	alt_u32 offset;
+	alt_u32 fixed = cycle_length() - Timings.active->timeouts[4]; // Every state but the side street green.
+
+	if (*args == '\0') {
+		coord_report(out, &Coordination);
+		return;
+	}
+	if (strcmp(args, "off") == 0) {
+		coord_stop(&Coordination);
+		fprintf(out, "Coordination off\n\r");
+		return;
+	}
+	cycle = strtoul(args, &end, 10);
+	offset = strtoul(end, &end, 10);
+	if (!coord_set(&Coordination, cycle, offset, fixed)) {
+		fprintf(out, "Usage: coord <cycle> <offset>, with a cycle of at least %lu ms\n\r", fixed + COORD_MIN_GREEN);
+		return;
+	}
+	fprintf(out, "Coordinating on a %lu ms cycle, offset %lu ms\n\r", cycle, offset % cycle);
+}
+
+void plans_command(FILE *out, const char *args) {
+	plan_report(out, &Plans);
+}
+
+void time_command(FILE *out, const char *args) {
+	// "time hh:mm" sets the wall clock and starts following the time of day plans.
+	char *end;
+	int hours = strtol(args, &end, 10);
+	int minutes = (*end == ':') ? strtol(end + 1, &end, 10) : -1;
+
+	if (!plan_set_time(&Plans, hours, minutes)) {
+		fprintf(out, "Usage: time hh:mm\n\r");
+		return;
+	}
+	fprintf(out, "Time set to %02d:%02d\n\r", hours, minutes);
+	plan_work(0);
+}
+
+void plan_work(alt_u32 unused) {
+	// Load the time of day plan when it changes.
+	const TimingPlan *plan = plan_update(&Plans);
+	alt_u32 timeouts[NUMBER_OF_TIMEOUT_VALUES];
+	int i;
+
+	if (plan == NULL) {
+		return;
+	}
+	for (i = 0; i < NUMBER_OF_TIMEOUT_VALUES; i++) {
+		timeouts[i] = plan->timeouts[i];
+	}
+	if (plan->flash) {
+		memcpy(timeouts, Timings.active->timeouts, sizeof(timeouts)); // Kept for leaving flash.
+	}
+	load_timing(timeouts, plan->flash);
+}
+
+void pedwait_command(FILE *out, const char *args) {
+	// "pedwait" shows the waits, "pedwait max <s>" sets the max wait policy (0 for off)
+	// and "pedwait clear" resets the statistics.
+	alt_u32 max_wait = Pedestrians.max_wait;
+
+	if (strncmp(args, "max", 3) == 0) {
+		Pedestrians.max_wait = strtoul(args + 3, NULL, 10) * alt_ticks_per_second();
+	} else if (strcmp(args, "clear") == 0) {
+		alt_irq_context context = alt_irq_disable_all();
+		pedwait_init(&Pedestrians);
+		Pedestrians.max_wait = max_wait;
+		alt_irq_enable_all(context);
 	}
+	pedwait_report(out, &Pedestrians);
+}
+
+void preempt_command(FILE *out, const char *args) {
+	preempt_report(out, &Preemption, preempt_bound());
+}
+
+void tsp_command(FILE *out, const char *args) {
+	tsp_report(out, &Transit);
+}
 
-	return currentTimeOut;
+void proto_command(FILE *out, const char *args) {
+	proto_report(out, &Protocol);
+}
+
+int timing_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_TIMING: flash, then t0..t5 in ms. Checked and published like a typed in line.
+	alt_u32 timeouts[NUMBER_OF_TIMEOUT_VALUES];
+	int i;
+
+	if (length != 1 + 2 * NUMBER_OF_TIMEOUT_VALUES) {
+		return FRAME_BAD_LENGTH;
+	}
+	for (i = 0; i < NUMBER_OF_TIMEOUT_VALUES; i++) {
+		timeouts[i] = frame_get16(&request[1 + 2 * i]);
+		if (!request[0] && (timeouts[i] == 0 || timeouts[i] >= 9999)) {
+			return FRAME_BAD_VALUE;
+		}
+	}
+	if (request[0]) {
+		memcpy(timeouts, Timings.active->timeouts, sizeof(timeouts)); // Kept for leaving flash.
+	}
+	load_timing(timeouts, request[0] != 0);
+	return FRAME_OK;
+}
+
+int plan_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_PLAN: index, start minute, flash, then t0..t5 in ms.
+	TimingPlan plan;
+	int i;
+
+	if (length != 4 + 2 * PLAN_TIMEOUTS) {
+		return FRAME_BAD_LENGTH;
+	}
+	plan.name = "Uploaded";
+	plan.start = frame_get16(&request[1]);
+	plan.flash = request[3] != 0;
+	for (i = 0; i < PLAN_TIMEOUTS; i++) {
+		plan.timeouts[i] = frame_get16(&request[4 + 2 * i]);
+		if (!plan.flash && (plan.timeouts[i] == 0 || plan.timeouts[i] >= 9999)) {
+			return FRAME_BAD_VALUE;
+		}
+	}
+	if (!plan_set(&Plans, request[0], &plan)) {
+		return FRAME_BAD_VALUE;
+	}
+	plan_work(0);
+	return FRAME_OK;
+}
+
+int mode_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_MODE: the mode to run while no mode switch is up, or 0 to stay in the current one.
+	if (length != 1) {
+		return FRAME_BAD_LENGTH;
+	}
+	if (request[0] > Mode5) {
+		return FRAME_BAD_VALUE;
+	}
+	RemoteMode = request[0];
+	return FRAME_OK;
+}
+
+int counters_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_COUNTERS: no payload.
+	alt_u32 counters[FRAME_COUNTER_VALUES];
+	int i;
+
+	if (length != 0) {
+		return FRAME_BAD_LENGTH;
+	}
+	counters[FRAME_COUNT_SWAPS] = Timings.swaps;
+	counters[FRAME_COUNT_PED_SERVED] = Pedestrians.served;
+	counters[FRAME_COUNT_PED_WAIT_MAX] = Pedestrians.wait_max * 1000 / alt_ticks_per_second();
+	counters[FRAME_COUNT_PREEMPTS] = Preemption.events;
+	counters[FRAME_COUNT_PREEMPT_LATENCY] = Preemption.latency_max * 1000 / alt_ticks_per_second();
+	counters[FRAME_COUNT_TSP_EXTENDED] = Transit.outcomes[TSP_EXTENDED];
+	counters[FRAME_COUNT_TSP_EARLY] = Transit.outcomes[TSP_EARLY];
+	counters[FRAME_COUNT_PLAN_CHANGES] = Plans.changes;
+	counters[FRAME_COUNT_FRAMES] = Protocol.frames;
+	counters[FRAME_COUNT_FRAME_ERRORS] = Protocol.errors;
+	for (i = 0; i < FRAME_COUNTER_VALUES; i++) {
+		frame_put32(&reply[4 * i], counters[i]);
+	}
+	*reply_length = 4 * FRAME_COUNTER_VALUES;
+	return FRAME_OK;
+}
+
+int log_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_LOG: which log. The reply is the number of entries, then the entries, oldest first.
+	PreemptEvent preempts[PREEMPT_LOG];
+	TspEvent buses[TSP_LOG];
+	int i;
+	int n;
+
+	if (length != 1) {
+		return FRAME_BAD_LENGTH;
+	}
+	if (request[0] == FRAME_LOG_PREEMPT) {
+		n = preempt_events(&Preemption, preempts);
+		for (i = 0; i < n; i++) {
+			reply[1 + 5 * i] = preempts[i].approach;
+			frame_put32(&reply[2 + 5 * i], preempts[i].latency * 1000 / alt_ticks_per_second());
+		}
+		*reply_length = 1 + 5 * n;
+	} else if (request[0] == FRAME_LOG_TSP) {
+		n = tsp_events(&Transit, buses);
+		for (i = 0; i < n; i++) {
+			reply[1 + 6 * i] = buses[i].approach;
+			reply[2 + 6 * i] = buses[i].outcome;
+			frame_put32(&reply[3 + 6 * i], buses[i].saved * 1000 / alt_ticks_per_second());
+		}
+		*reply_length = 1 + 6 * n;
+	} else {
+		return FRAME_BAD_VALUE;
+	}
+	reply[0] = n;
+	return FRAME_OK;
+}
+
+int telemetry_request(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	// FRAME_TELEMETRY: rate in Hz, or 0 to stop.
+	if (length != 1) {
+		return FRAME_BAD_LENGTH;
+	}
+	return telemetry_set_rate(&Stream, request[0]) ? FRAME_OK : FRAME_BAD_VALUE;
+}
+
+void telemetry_command(FILE *out, const char *args) {
+	// "telemetry <Hz>" starts the stream, "telemetry off" stops it and "telemetry" shows the counts.
+	char *end;
+	unsigned long rate;
+
+	if (strcmp(args, "off") == 0) {
+		telemetry_set_rate(&Stream, 0);
+	} else if (*args != '\0') {
+		rate = strtoul(args, &end, 10);
+		if (*end != '\0' || rate > TELEMETRY_MAX_RATE || !telemetry_set_rate(&Stream, rate)) {
+			fprintf(out, "Usage: telemetry <1-%d Hz>|off\n\r", TELEMETRY_MAX_RATE);
+			return;
+		}
+	}
+	telemetry_report(out, &Stream);
+}
+
+void uart_command(FILE *out, const char *args) {
+	// "uart" shows the uart driver's error counters and how full its buffers have been, "uart clear" resets them.
+	altera_avalon_uart_stats stats;
+
+	if (strcmp(args, "clear") == 0) {
+		ioctl(uart_rx, TIOCCUARTSTATS, NULL);
+	}
+	if (ioctl(uart_rx, TIOCGUARTSTATS, &stats) != 0) {
+		fprintf(out, "Uart counters unavailable\n\r");
+		return;
+	}
+	fprintf(out, "Uart rx: %lu overruns, %lu framing, %lu parity, %lu lines dropped, high %lu of %lu\n\r",
+			stats.rx_overruns, stats.rx_framing, stats.rx_parity, stats.rx_dropped, stats.rx_high, stats.rx_size);
+	fprintf(out, "Uart tx: full %lu times, high %lu of %lu\n\r", stats.tx_full, stats.tx_high, stats.tx_size);
+}
+
+void telemetry_sample(TelemetrySample *sample, void *context) {
+	// Called from the telemetry alarm. It only copies, so it can't disturb the signal timing.
+	alt_u32 now = alt_nticks();
+
+	sample->tick = now;
+	sample->mode = *(enum OpperationMode*) context;
+	sample->state = (CurrentState + PHASE_STATES - 1) % PHASE_STATES; // CurrentState is the next state.
+	sample->flags = (EW_Ped ? TELEMETRY_EW_PED : 0) | (NS_Ped ? TELEMETRY_NS_PED : 0) |
+			(Flashing ? TELEMETRY_FLASHING : 0) | (Preemption.call >= 0 ? TELEMETRY_PREEMPTED : 0);
+	sample->remaining = (alt_32) (Phase.deadline - now) > 0 ? Phase.deadline - now : 0;
+	sample->detections[APPROACH_EW] = Actuation.detections[APPROACH_EW];
+	sample->detections[APPROACH_NS] = Actuation.detections[APPROACH_NS];
+}
+
+void timing_command(FILE *out, const char *args) {
+	timing_report(out, &Timings);
+}
+
+void sync_command(FILE *out, const char *args) {
+	// Sent to every controller on the corridor at once, to start their cycles together.
+	alt_u32 now = alt_nticks();
+	coord_sync(&Coordination, now);
+	fprintf(out, "Cycle epoch at tick %lu\n\r", now);
 }
 
 
@@ -174,6 +626,7 @@ void ResetAllStates(void){
 	//Reset the button press flags.
 	EW_Ped = 0;
 	NS_Ped = 0;
+	pedwait_clear(&Pedestrians);
 
 }
 
@@ -182,170 +635,204 @@ void UpdateMode(enum OpperationMode *currentMode){
 	if (InSafeState()) { //Only change mode when in a safe state.
 		// Check which mode switch is asserted and update the current mode.
 		// If the mode has changes since last time, update the lcd. (This will stop the lcd from flickering).
+		// The lcd is slow, so the update is deferred to the main loop.
 		unsigned int modeSwitchValue = IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE);
 		if ((modeSwitchValue & 1<<0)) {
 			if (*currentMode != Mode1){
-				lcd_set_mode(Mode1);
+				workq_post(lcd_mode_work, Mode1);
 				ResetAllStates();
 			}
 			(*currentMode) = Mode1;
 
 		} else if ((modeSwitchValue & 1<<1)) {
 			if (*currentMode != Mode2){
-				lcd_set_mode(Mode2);
+				workq_post(lcd_mode_work, Mode2);
 				ResetAllStates();
 			}
 			(*currentMode) = Mode2;
 		} else if ((modeSwitchValue & 1<<2)) {
 			if (*currentMode != Mode3){
-				lcd_set_mode(Mode3);
+				workq_post(lcd_mode_work, Mode3);
 				ResetAllStates();
 			}
 			(*currentMode) = Mode3;
 		} else if ((modeSwitchValue & 1<<3)) {
 			if (*currentMode != Mode4){
-				lcd_set_mode(Mode4);
+				workq_post(lcd_mode_work, Mode4);
 				ResetAllStates();
 			}
 			(*currentMode) = Mode4;
+		} else if ((modeSwitchValue & 1<<4)) {
+			if (*currentMode != Mode5){
+				workq_post(lcd_mode_work, Mode5);
+				ResetAllStates();
+			}
+			(*currentMode) = Mode5;
+		} else if (RemoteMode != 0) {
+			if (*currentMode != RemoteMode){
+				workq_post(lcd_mode_work, RemoteMode);
+				ResetAllStates();
+			}
+			(*currentMode) = RemoteMode;
 		}
 	}
 	return;
 }
 
 int InSafeState (void) {
-	// Check if the fsm is in a red-red state.
-	if (CurrentState == 0 || CurrentState == 3){
-		return 1;
-	} else {
-		return 0;
+	// Check if the fsm is in a red-red state. Every mode has the same safe states.
+	return (phase_table(Mode1)[CurrentState].flags & PHASE_SAFE) != 0;
+}
+
+FILE *lcd_open(void) {
+	// Open the lcd once, rather than leaking a descriptor per write.
+	static FILE *lcd = NULL;
+	if (lcd == NULL) {
+		lcd = fopen(LCD_NAME, "w");
 	}
+	return lcd;
 }
 
+#define ESC 27
+#define LCD_LINE1 "[1;1H"
+#define LCD_LINE2 "[2;1H"
+#define LCD_CLEAR_TO_END "[K"
+
 void lcd_set_mode(enum OpperationMode currentMode) {
-	// Clear then write the current mode to the lcd.
-	#define ESC 27
-	#define CLEAR_LCD_STRING "[2J"
-	FILE *lcd;
-	lcd = fopen(LCD_NAME, "w");
+	// Write the current mode to the first line of the lcd. Not to be called from an ISR.
+	// The driver only sends the cells that changed, so this is a single character write.
+	FILE *lcd = lcd_open();
 	if(lcd != NULL){
-		fprintf(lcd, "%c%s", ESC, CLEAR_LCD_STRING);
-		fprintf(lcd, "MODE: %d\n", currentMode);
+		fprintf(lcd, "%c%sMODE: %d%c%s", ESC, LCD_LINE1, currentMode, ESC, LCD_CLEAR_TO_END);
+		fflush(lcd);
 	}
 	return;
 }
 
-void simple_tlc() {
-	// Update the traffic light leds bused on the current state.
-	switch ((CurrentState)) {
-	case 0:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100100); //NS:Red EW:Red (safe state)
-		currentTimeOut = t0;
-		break;
-	case 1:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00001100); //NS:Green EW:Red
-		currentTimeOut = t1;
-		break;
-	case 2:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00010100); //NS:Yellow EW:Red
-		currentTimeOut = t2;
-		break;
-	case 3:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100100); //NS:Red EW:Red (safe state)
-		currentTimeOut = t3;
-		break;
-	case 4:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100001); //NS:Red EW:Green
-		currentTimeOut = t4;
-		break;
-	case 5:
-		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100010); //NS:Red EW:Yellow
-		currentTimeOut = t5;
-		break;
+void lcd_status_work(alt_u32 unused) {
+	// Show the current state and the seconds until the next transition on the second line.
+	FILE *lcd = lcd_open();
+	alt_u32 remaining = 0;
+	if (lcd == NULL) {
+		return;
+	}
+	if ((alt_32) (Phase.deadline - alt_nticks()) > 0) {
+		remaining = (Phase.deadline - alt_nticks()) / alt_ticks_per_second();
+	}
+	if (Flashing) {
+		fprintf(lcd, "%c%sFLASH%c%s", ESC, LCD_LINE2, ESC, LCD_CLEAR_TO_END);
+	} else {
+		// CurrentState is the next state, the countdown belongs to the one before it.
+		fprintf(lcd, "%c%sSTATE: %d  %2lus%c%s", ESC, LCD_LINE2, (CurrentState + PHASE_STATES - 1) % PHASE_STATES,
+				remaining, ESC, LCD_CLEAR_TO_END);
 	}
+	fflush(lcd);
 }
 
-void init_buttons_pio(void* context) {
-	IOWR_ALTERA_AVALON_PIO_EDGE_CAP(KEYS_BASE, 0); // enable interrupts for buttons
-	IOWR_ALTERA_AVALON_PIO_IRQ_MASK(KEYS_BASE, 0x7); // enable interrupts for all buttons.
-	alt_irq_register(KEYS_IRQ,context, NSEW_ped_isr);
+alt_u32 status_timer_isr(void* context) {
+	// Refresh the countdown and check the time of day plan once a second. Both are deferred to the main loop.
+	workq_post(lcd_status_work, 0);
+	workq_post(plan_work, 0);
+	return alt_ticks_per_second();
 }
 
-void nextState(enum OpperationMode *currentMode){
-	// If receiving new data, stay in safe state.
-	if (InSafeState() && (IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE) & (1<<17)) && (((*currentMode) == Mode3) || (*currentMode) == Mode4)){
+void lcd_mode_work(alt_u32 mode) {
+	lcd_set_mode((enum OpperationMode) mode);
+}
+
+void run_phase(enum OpperationMode mode) {
+	// Update the traffic light leds from the current state's row of the phase table.
+	const PhaseRow *row = &phase_table(mode)[CurrentState];
+	alt_u8 waiting = (NS_Ped ? SIG_NS_WALK : 0) | (EW_Ped ? SIG_EW_WALK : 0);
+	alt_u8 walk = row->walk & waiting;
 
-	}else {
-		// Proceed to next state.
-		CurrentState++;
-		CurrentState = CurrentState%6;
+	if (row->flags & PHASE_WALK_START) {
+		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE, IORD_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE) & ~row->wait);
+		even_button = 0;
+		if (walk) {
+			pedwait_served(&Pedestrians, (walk & SIG_NS_WALK) ? PED_NS : PED_EW, alt_nticks());
+		}
+	}
+	IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, row->signals | walk);
+	if ((row->flags & PHASE_WALK_END) && walk) {
+		// The pedestrian has crossed.
+		if (walk & SIG_NS_WALK) {
+			NS_Ped = 0;
+		} else {
+			EW_Ped = 0;
+		}
 	}
+	currentTimeOut = Timings.active->timeouts[row->timeout];
 }
-void pedestrian_tlc(void) {
-	//Mode 2. Implements the same logic as mode 1, adding pedestrian logic.
-	int current_red_led = IORD_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE);
-	switch ((CurrentState)) {
-		case 0:
-			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100100); //NS:Red EW:Red (safe state)
-			currentTimeOut = t0;
-			break;
-		case 1:
-			current_red_led = current_red_led & ~(1<<1);
-			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE, current_red_led);
-			if (NS_Ped == 1){
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b10001100); //NS:Green EW:Red
-			}else {
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00001100); //NS:Green EW:Red
-			}
-			currentTimeOut = t1;
-			even_button = 0;
-			break;
-		case 2:
 
-			if (NS_Ped == 1){
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b10010100); //NS:Yellow EW:Red
+void actuated_select(void) {
+	// Mode 5. Called before showing the next state. A green nobody is waiting for is
+	// skipped, going from this all red straight to the other approach's green,
+	// which is half a cycle on.
+	const PhaseRow *row = &phase_table(Mode5)[CurrentState];
+	int skip = 0;
 
-				NS_Ped = 0;
-			} else {
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00010100); //NS:Yellow EW:Red
-			}
-			currentTimeOut = t2;
-			break;
-		case 3:
-			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100100); //NS:Red EW:Red (safe state)
-			currentTimeOut = t3;
-			break;
-		case 4:
-			current_red_led = current_red_led & ~(1<<0);
-			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE, current_red_led);
+	if (row->signals & SIG_NS_GREEN) {
+		skip = actuated_skip(&Actuation, APPROACH_NS, NS_Ped, EW_Ped);
+	} else if (row->signals & SIG_EW_GREEN) {
+		skip = actuated_skip(&Actuation, APPROACH_EW, EW_Ped, NS_Ped);
+	}
+	if (skip) {
+		CurrentState = (CurrentState + PHASE_STATES / 2) % PHASE_STATES;
+	}
+}
 
-			if (EW_Ped == 1) {
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b01100001); //NS:Red EW:Green
-			}else{
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100001); //NS:Red EW:Green
-			}
-			currentTimeOut = t4;
-			even_button = 0;
-			break;
-		case 5:
-			if (EW_Ped == 1) {
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b01100010); //NS:Red EW:Yellow
-				EW_Ped = 0;
-			} else {
-				IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, 0b00100010); //NS:Red EW:Yellow
-			}
-			currentTimeOut = t5;
-			break;
-		}
+void actuated_time_green(void) {
+	// Mode 5. A green just shown runs for its minimum, then is extended by detector events.
+	const PhaseRow *row = &phase_table(Mode5)[CurrentState];
+
+	if (row->signals & SIG_NS_GREEN) {
+		currentTimeOut = actuated_green_start(&Actuation, APPROACH_NS, alt_nticks());
+	} else if (row->signals & SIG_EW_GREEN) {
+		currentTimeOut = actuated_green_start(&Actuation, APPROACH_EW, alt_nticks());
+	}
 }
 
+void init_buttons_pio(void* context) {
+	IOWR_ALTERA_AVALON_PIO_EDGE_CAP(KEYS_BASE, 0); // enable interrupts for buttons
+	IOWR_ALTERA_AVALON_PIO_IRQ_MASK(KEYS_BASE, 0x7); // enable interrupts for all buttons.
+	alt_irq_register(KEYS_IRQ,context, NSEW_ped_isr);
+#ifdef ALT_IRQ_NESTING
+	// Buttons and uart input preempt the timer and jtag uart handlers.
+	alt_irq_priority_set(KEYS_IRQ, 0);
+	alt_irq_priority_set(UART_IRQ, 0);
+#endif
+}
 
+void nextState(enum OpperationMode *currentMode){
+	// Proceed to next state. Receiving new timeouts no longer holds the fsm in a safe state.
+	CurrentState++;
+	if (CurrentState >= PHASE_STATES) {
+		CurrentState = 0;
+	}
+}
+alt_u32 ped_bound_end(int crossing, const PhaseRow *table, int green, alt_u32 start) {
+	// The tick the conflicting "green", which started at "start", has to end by for the request
+	// waiting on "crossing" to walk within the max wait. Never before the green's minimum.
+	const alt_u32 *timeouts = Timings.active->timeouts;
+	alt_u32 clearance;
+	alt_u32 end;
+
+	// The yellow and red-red states come between the end of this green and the walk.
+	clearance = timeouts[table[(green + 1) % PHASE_STATES].timeout] + timeouts[table[(green + 2) % PHASE_STATES].timeout];
+	end = Pedestrians.pressed[crossing] + Pedestrians.max_wait - clearance;
+	if ((alt_32) (end - (start + PEDWAIT_MIN_GREEN)) < 0) {
+		end = start + PEDWAIT_MIN_GREEN;
+	}
+	return end;
+}
 
 void NSEW_ped_isr(void* context, alt_u32 id) {
 	// ISR to handel pedestrian and car enter intersection buttons being pressed.
 	unsigned int buttonValue = IORD_ALTERA_AVALON_PIO_DATA(KEYS_BASE);
 	int current_red_led = IORD_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE);
 	enum OpperationMode *currentMode = (unsigned int*) context;
+	const PhaseRow *row = &phase_table(*currentMode)[(CurrentState + PHASE_STATES - 1) % PHASE_STATES]; // CurrentState is the next state.
 
 	//Only use the buttons in mode 2,3,4
 	if (*currentMode == Mode1) {
@@ -353,72 +840,272 @@ void NSEW_ped_isr(void* context, alt_u32 id) {
 	}
 
 	if (!(buttonValue & 1<<0)) { // If EW button has been pressed.
-		// Only accept pedestrian button when condition matches x,R
-		if (!(CurrentState == 4 || CurrentState == 5)) {
+		// Only accept pedestrian button while the EW lights are not green or yellow.
+		if (!(row->signals & (SIG_EW_GREEN | SIG_EW_YELLOW))) {
 			// Toggle button press flag and assert the red led to indicate the pedestrian should wait.
 			EW_Ped = 1;
 			current_red_led = current_red_led | 0b01;
 			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE, current_red_led);
+			if (pedwait_press(&Pedestrians, PED_EW, alt_nticks())) {
+				ped_bound_wait(PED_EW, context);
+			}
 
 		}
 
 	} else if (!(buttonValue & 1<<1)) {
-		// Only accept pedestrian button when condition matches R,x
-		if (!(CurrentState == 1 || CurrentState == 2)) {
+		// Only accept pedestrian button while the NS lights are not green or yellow.
+		if (!(row->signals & (SIG_NS_GREEN | SIG_NS_YELLOW))) {
 			// Toggle button press flag and assert the red led to indicate the pedestrian should wait.
 			NS_Ped = 1;
 			current_red_led = current_red_led | 0b10;
 			IOWR_ALTERA_AVALON_PIO_DATA(LEDS_RED_BASE, current_red_led);
+			if (pedwait_press(&Pedestrians, PED_NS, alt_nticks())) {
+				ped_bound_wait(PED_NS, context);
+			}
 		}
 	} else if (!(buttonValue & 1<<2) && *currentMode == Mode4) {
 		// Car enter intersection button pressed. Call corresponding handler.
 		handle_vehicle_button(currentMode);
+	} else if (!(buttonValue & 1<<2) && *currentMode == Mode5) {
+		// Vehicle detector. Switch 16 selects the approach it is on (low EW, high NS).
+		int approach = (IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE) & 1<<16) ? APPROACH_NS : APPROACH_EW;
+		actuated_detect(&Actuation, approach, alt_nticks());
 	}
 	// Clear the edge capture.
 	IOWR_ALTERA_AVALON_PIO_EDGE_CAP(KEYS_BASE, 0);
 }
 
-void configurable_tlc(enum OpperationMode *currentMode){
-	// Mode 3
-	pedestrian_tlc(); // Call mode 2. The additional functionality is handled with interrupts.
+void ped_bound_wait(int crossing, void* context) {
+	// Max wait policy, called from the button ISR for a new request. If the conflicting green is
+	// showing and would hold the walk back past the max wait, end it early, but not before it has
+	// run for its minimum. A request made before the conflicting green starts is bounded by
+	// tlc_timer_isr() when it does. Mode 5 greens are already bounded by their max green.
+	enum OpperationMode *currentMode = (unsigned int*) context;
+	const PhaseRow *table = phase_table(*currentMode);
+	int shown = (CurrentState + PHASE_STATES - 1) % PHASE_STATES; // CurrentState is the next state.
+	alt_u8 conflicting = (crossing == PED_NS) ? SIG_EW_GREEN : SIG_NS_GREEN;
+	alt_u32 now = alt_nticks();
+	alt_u32 end;
+
+	if (Pedestrians.max_wait == 0 || Flashing || Preemption.call >= 0 || *currentMode == Mode5
+			|| !(table[shown].signals & conflicting)) {
+		return;
+	}
+	end = ped_bound_end(crossing, table, shown, Phase.deadline - Phase.interval);
+	if ((alt_32) (end - now) <= 0) {
+		end = now + 1;
+	}
+	if (end_state_at(end, context)) {
+		Pedestrians.shortened++;
+	}
 }
 
-void camera_tlc(enum OpperationMode *currentMode){
-	// Mode 4
-	pedestrian_tlc(); // Call mode 3. The additional functionality is handled with interrupts.
+int end_state_at(alt_u32 end, void* context) {
+	// End the state showing at tick "end", if that is before its planned end. Called from ISRs.
+	// Returns 1 if the state was cut short.
+	if ((alt_32) (end - Phase.deadline) >= 0) {
+		return 0;
+	}
+	alt_alarm_stop(&timer);
+	alt_alarm_start_at(&timer, phase_shorten(&Phase, end), tlc_timer_isr, context);
+	return 1;
+}
+
+int extend_state_to(alt_u32 end, void* context) {
+	// End the state showing at tick "end", if that is after its planned end. Called from ISRs.
+	// Returns 1 if the state was lengthened.
+	if ((alt_32) (end - Phase.deadline) <= 0) {
+		return 0;
+	}
+	alt_alarm_stop(&timer);
+	alt_alarm_start_at(&timer, phase_extend(&Phase, end), tlc_timer_isr, context);
+	return 1;
+}
+
+int green_state(const PhaseRow *table, alt_u8 green) {
+	// The state of a table that shows the "green" signal.
+	int state;
+	for (state = 0; state < PHASE_STATES; state++) {
+		if (table[state].signals & green) {
+			return state;
+		}
+	}
+	return 0;
+}
+
+alt_u32 preempt_bound(void) {
+	// Guaranteed preemption latency: the poll period, then the longest yellow and red-red
+	// after a conflicting green is ended.
+	const PhaseRow *table = phase_table(Mode2);
+	const alt_u32 *timeouts = Timings.active->timeouts;
+	alt_u32 yellow = 0;
+	alt_u32 red = 0;
+	int state;
+
+	for (state = 0; state < PHASE_STATES; state++) {
+		alt_u32 timeout = timeouts[table[state].timeout];
+		if ((table[state].signals & (SIG_NS_YELLOW | SIG_EW_YELLOW)) && timeout > yellow) {
+			yellow = timeout;
+		}
+		if ((table[state].flags & PHASE_SAFE) && timeout > red) {
+			red = timeout;
+		}
+	}
+	return PREEMPT_POLL + 1 + yellow + red;
+}
+
+alt_u32 switch_poll_isr(void* context) {
+	// The switches have no interrupt, so preemption and transit priority inputs are polled.
+	unsigned int switches = IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE);
+	preempt_poll(switches, context);
+	tsp_poll(switches, context);
+	return PREEMPT_POLL;
+}
+
+void preempt_poll(unsigned int switches, void* context) {
+	// A new preemption call ends a conflicting green now, and dropping the call ends the
+	// held green. Yellow and red-red always run their full time.
+	enum OpperationMode *currentMode = (unsigned int*) context;
+	int call = (switches & 1<<15) ? APPROACH_NS : ((switches & 1<<14) ? APPROACH_EW : -1);
+	int held = Preemption.reached;
+	const PhaseRow *table = phase_table(*currentMode);
+	int shown = (CurrentState + PHASE_STATES - 1) % PHASE_STATES; // CurrentState is the next state.
+	alt_u32 now = alt_nticks();
+
+	if (!preempt_call(&Preemption, call, now) || Flashing) {
+		return;
+	}
+	Actuation.green = -1; // A green showing now is no longer timed by the detector.
+	if (call < 0) {
+		if (held) {
+			end_state_at(now + 1, context);
+		}
+	} else if (shown == green_state(table, call == APPROACH_NS ? SIG_NS_GREEN : SIG_EW_GREEN)) {
+		// Already green. Hold it.
+		if (preempt_reached(&Preemption, now, preempt_bound())) {
+			log_preemption();
+		}
+	} else if (table[shown].signals & (SIG_NS_GREEN | SIG_EW_GREEN)) {
+		end_state_at(now + 1, context);
+	}
+}
+
+void tsp_poll(unsigned int switches, void* context) {
+	// A bus checks in when its switch is raised (13 for NS, 12 for EW). Priority is not given
+	// while preempted or flashing, or in mode 5, where the detector already times the greens.
+	static unsigned int last = 0;
+	unsigned int raised = switches & ~last & (1<<13 | 1<<12);
+	enum OpperationMode *currentMode = (unsigned int*) context;
+	const PhaseRow *table = phase_table(*currentMode);
+	int shown = (CurrentState + PHASE_STATES - 1) % PHASE_STATES; // CurrentState is the next state.
+	int approach;
+	TspView view;
+	alt_u32 end;
+
+	last = switches;
+	if (!raised || Flashing || Preemption.call >= 0 || *currentMode == Mode5) {
+		return;
+	}
+	for (approach = 0; approach < APPROACHES; approach++) {
+		if (!(raised & (approach == APPROACH_NS ? 1<<13 : 1<<12))) {
+			continue;
+		}
+		tsp_view(table, approach, shown, Phase.deadline - Phase.interval, Phase.deadline, &view);
+		end = tsp_request(&Transit, approach, alt_nticks(), &view);
+		if (end && !end_state_at(end, context)) {
+			extend_state_to(end, context);
+		}
+	}
+}
+
+void tsp_view(const PhaseRow *table, int approach, int shown, alt_u32 start, alt_u32 end, TspView *view) {
+	// Where "approach" is in the cycle, with state "shown" running from "start" to "end",
+	// and when its green next starts with the active timeouts.
+	const alt_u32 *timeouts = Timings.active->timeouts;
+	alt_u8 green = approach == APPROACH_NS ? SIG_NS_GREEN : SIG_EW_GREEN;
+	alt_u8 other = approach == APPROACH_NS ? SIG_EW_GREEN : SIG_NS_GREEN;
+	int state;
+
+	view->start = start;
+	view->end = end;
+	view->next_green = end;
+	view->where = (table[shown].signals & green) ? TSP_GREEN : ((table[shown].signals & other) ? TSP_CONFLICT : -1);
+	for (state = (shown + 1) % PHASE_STATES; !(table[state].signals & green); state = (state + 1) % PHASE_STATES) {
+		if (view->where < 0 && (table[state].signals & other)) {
+			view->where = TSP_MISSED; // The conflicting green comes first.
+		}
+		view->next_green += timeouts[table[state].timeout];
+	}
+	if (view->where < 0) {
+		view->where = TSP_CLEARING;
+	}
+}
+
+alt_u32 preempt_step(enum OpperationMode *currentMode) {
+	// Preemption, in place of the normal transition. Runs the clearance states in order and
+	// goes from red-red straight to the called green, then holds it. Walk lights are not
+	// shown, so waiting pedestrians are served after the preemption.
+	const PhaseRow *table = phase_table(*currentMode);
+	int green = green_state(table, Preemption.call == APPROACH_NS ? SIG_NS_GREEN : SIG_EW_GREEN);
+	int shown = (CurrentState + PHASE_STATES - 1) % PHASE_STATES;
+
+	if (shown != green) {
+		if (table[CurrentState].signals & (SIG_NS_GREEN | SIG_EW_GREEN)) {
+			CurrentState = green;
+		}
+		shown = CurrentState;
+		IOWR_ALTERA_AVALON_PIO_DATA(LEDS_GREEN_BASE, table[shown].signals);
+		nextState(currentMode);
+		workq_post(lcd_status_work, 0);
+		if (shown != green) {
+			return Timings.active->timeouts[table[shown].timeout];
+		}
+	}
+	if (preempt_reached(&Preemption, alt_nticks(), preempt_bound())) {
+		log_preemption();
+	}
+	return PREEMPT_HOLD;
+}
+
+void log_preemption(void) {
+	// Log the latest preemption on the uart.
+	const PreemptEvent *event = &Preemption.log[(Preemption.log_next + PREEMPT_LOG - 1) % PREEMPT_LOG];
+	tlog2(LOG_PREEMPTED, event->approach, event->latency);
+}
+
+void preempt_convert(alt_u32 *args) {
+	args[0] = (alt_u32) (args[0] == APPROACH_NS ? "NS" : "EW");
+	args[1] = args[1] * 1000 / alt_ticks_per_second();
 }
 
 void handle_vehicle_button(enum OpperationMode *currentMode){
+	const PhaseRow *row = &phase_table(*currentMode)[(CurrentState + PHASE_STATES - 1) % PHASE_STATES]; // CurrentState is the next state.
 	even_button = 1 - even_button; //Toggle the even button press flag.
 
-	if (CurrentState == 0 || CurrentState == 3){ // Orange-Red or Red-Orange state.
+	if (row->signals & (SIG_NS_YELLOW | SIG_EW_YELLOW)){ // Orange-Red or Red-Orange state.
 		//Start camera timer
 		if (even_button == 1){ //check if button is even (Enter intersection)
 			if(camera_has_started == 0){
 				alt_alarm_start(&CameraTimer, CAMERA_TIMEOUT, camera_timer_isr, (void*) currentMode); //Start the camera timer
 				camera_has_started = 1;
-				// Start the timer to check how long the car was in the intersection
-				alt_alarm_start(&TimerInIntersection, INTERSECTION_TIMEOUT, in_intersection_timer_isr, (void*) currentMode);
-				fprintf(fp,"Camera activated \n\r");
+				// Timestamp the entry to check how long the car was in the intersection
+				capture_entry(&InIntersection);
+				tlog0(LOG_CAMERA_ON);
 			}
 		} else if(camera_has_started == 1){ // Car leaving intersection.
-			// Stop the camera timers and display how long the car was in the intersection.
+			// Stop the camera timer and display how long the car was in the intersection.
 			alt_alarm_stop(&CameraTimer);
-			alt_alarm_stop(&TimerInIntersection);
-			fprintf(fp,"Vehicle left after %d milliseconds \n\r", time_in_intersection);
-			time_in_intersection = 0;
+			report_vehicle_left();
 			camera_has_started = 0;
 		}
-	} else if (CurrentState == 1 || CurrentState == 4){ // Red-Red state.
+	} else if (row->flags & PHASE_SAFE){ // Red-Red state.
 		if (even_button == 1){
 			takeSnapshot();
-			alt_alarm_stop(&TimerInIntersection);
+			capture_cancel(&InIntersection);
 		} else if(camera_has_started == 1){
 			// The car entered in orange-red / red-orange and left in red-red.
 			alt_alarm_stop(&CameraTimer);
-			alt_alarm_stop(&TimerInIntersection);
-			fprintf(fp,"Vehicle left after %d milliseconds \n\r", time_in_intersection);
-			time_in_intersection = 0;
+			report_vehicle_left();
 			camera_has_started = 0;
 		}
 	} else {
@@ -427,96 +1114,51 @@ void handle_vehicle_button(enum OpperationMode *currentMode){
 	}
 }
 
-void handle_intersection_timer(){
-	// Only start the timer if it hasn't alreadyy been started.
-	if (camera_has_started == 0){
-		alt_alarm_stop(&TimerInIntersection);
-		time_in_intersection = 0;
+void report_vehicle_left(void){
+	// Close the intersection capture and defer displaying how long the car was in the intersection.
+	alt_u32 ticks;
+	if (capture_exit(&InIntersection, &ticks)){
+		tlog1(LOG_VEHICLE_LEFT, ticks);
 	}
 }
 
+void vehicle_left_convert(alt_u32 *args){
+	alt_u32 us = capture_ticks_to_us(args[0]);
+	args[0] = us / 1000;
+	args[1] = us % 1000;
+}
+
 alt_u32 camera_timer_isr(void* context, alt_u32 id){
 	// Camera timer has expired, stop the timer and take a snapshot.
 	enum OpperationMode *currentMode = (unsigned int*) context;
 	camera_has_started = 0;
 	even_button = 0;
+	capture_cancel(&InIntersection); // The car is no longer being timed once the snapshot is taken.
 	takeSnapshot();
 	return 0;
 }
 
-alt_u32 in_intersection_timer_isr(void* context, alt_u32 id){
-	// Count the number of 1ms overflows to keep track of how long the car has been in intersection.
-	enum OpperationMode *currentMode = (unsigned int*) context;
-	time_in_intersection++;
-	handle_intersection_timer();
-	return 1;
-
-}
-
 void takeSnapshot(void){
-	// Indicate a snapshot has been taken.
-	fprintf(fp,"Snapshot taken \n\r");
+	// Indicate a snapshot has been taken. Called from ISRs, so the message is deferred.
+	tlog0(LOG_SNAPSHOT);
 }
 
 void timeout_data_handler(enum OpperationMode *currentMode){
-	//If the traffic lights are in a safe state, in mode 3,4 and switch 17 is asserted, pole uart for new timeout values.
-	if ((*currentMode == 3 || *currentMode == 4)) { //Mode 3 or 4 only.
-		if (InSafeState()) { //Only update time values when in a safe state. (Red Red)
-			unsigned int modeSwitchValue = IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE);
-			if ((modeSwitchValue & 1<<17)) { // Check if switch 17 is asserted high (Indicating new timeout values).
-				recieve_new_data = 1;
-				if (timer_running == 1){
-					printf("stopped the timer and expecting new values.");
-					alt_alarm_stop(&timer);
-					timer_running = 0;
-				}
-			} else {
-				recieve_new_data = 0;
-				//printf("Restart the timer lul \n.");
-			}
-		}
-	}
+	// In mode 3,4 with switch 17 asserted, pole the uart for new timeout values instead of console commands.
+	// The timer keeps running. New values are double buffered and only swapped in at a safe state.
+	unsigned int modeSwitchValue = IORD_ALTERA_AVALON_PIO_DATA(SWITCHES_BASE);
+	recieve_new_data = (*currentMode == Mode3 || *currentMode == Mode4) && (modeSwitchValue & 1<<17);
 }
 
-int ParseNewTimeout(char *New_Timeout, int New_Timeout_Index){
-	//Parse the input to retrieve the new timeout values.
-	int TempValues[NUMBER_OF_TIMEOUT_VALUES];
-	char *token;
-	int numberOfTokens = 0;
-	//Get the first token from received string (separated by commas).
-	token = strtok(New_Timeout, ",");
+int ParseNewTimeout(const char *line, int length){
+	// Parse "t0,t1,t2,t3,t4,t5" in one pass, and publish the values for the next safe state.
+	TimeoutParser parser;
 
-	// Go through all tokens in the string.
-	while(token != NULL) {
-		if (numberOfTokens >= NUMBER_OF_TIMEOUT_VALUES){ //If there are more than 6 tokens, this is not valid.
-			printf("Returned from too many tokens: %d.\n\r", numberOfTokens);
-			return 0;
-		}
-		int temp = atoi(token); //Convert the string to integer. Note we are treating digits followed by characters as valid input.
-		if (temp <= 0 || temp >= 9999) { //Values are only valid if they are 1-4 digits. atoi will return 0 for non numbers.
-			printf("Timout value is not in valid range: %d.\n", temp);
-			return 0;
-		}
-		TempValues[numberOfTokens] = temp; //Store valid values into a buffer.
-		numberOfTokens++;
-		printf( "%d,\t", temp );
-		token = strtok(NULL, ","); // Get the next token.
-	}
-	printf("Finished passing all the inputs.\n");
-	printf("Number of tokens = %d\n", numberOfTokens);
-	if (numberOfTokens == NUMBER_OF_TIMEOUT_VALUES) { //There are 6 valid numbers received. Update global times.
-		printf("Updating globals.\n");
-		fprintf(fp, "Updating timout values.\n\r");
-		t0 = TempValues[0];
-		t1 = TempValues[1];
-		t2 = TempValues[2];
-		t3 = TempValues[3];
-		t4 = TempValues[4];
-		t5 = TempValues[5];
-	}
-	else {
+	if (parse_line(&parser, line, length) != PARSE_OK) {
+		fprintf(fp, "Invalid input: %s at column %d\n\r", parse_error(parser.error), parser.column);
 		return 0;
 	}
-	
+	fprintf(fp, "Updating timout values at the next safe state.\n\r");
+	load_timing(parser.values, 0);
 	return 1;
 }
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "capture.h"
+#include "sys/alt_timestamp.h"
+
+static const char *const error_names[] = {
+	"ok", "unexpected character", "missing value", "too many digits",
+	"value out of range", "too many values", "too few values",
+};
+
+void parse_init(TimeoutParser *parser) {
+	parser->count = 0;
+	parser->value = 0;
+	parser->digits = 0;
+	parser->column = 0;
+	parser->error = PARSE_OK;
+}
+
+static int parse_value_end(TimeoutParser *parser) {
+	// Check and store the value just read.
+	if (parser->digits == 0) {
+		return PARSE_EMPTY_VALUE;
+	}
+	if (parser->value == 0 || parser->value > PARSE_MAX_VALUE) {
+		return PARSE_OUT_OF_RANGE;
+	}
+	parser->values[parser->count++] = parser->value;
+	parser->value = 0;
+	parser->digits = 0;
+	return PARSE_OK;
+}
+
+int parse_byte(TimeoutParser *parser, char c) {
+	// Feed the next byte of the line. Returns the error so far.
+	if (parser->error != PARSE_OK) {
+		return parser->error;
+	}
+	parser->column++;
+	if (c >= '0' && c <= '9') {
+		if (parser->digits == PARSE_MAX_DIGITS) {
+			parser->error = PARSE_TOO_LONG;
+		} else {
+			parser->value = (parser->value << 3) + (parser->value << 1) + (c - '0'); // value * 10
+			parser->digits++;
+		}
+	} else if (c == ',') {
+		parser->error = parse_value_end(parser);
+		if (parser->error == PARSE_OK && parser->count == PARSE_VALUES) {
+			parser->error = PARSE_TOO_MANY; // A comma after the last value.
+		}
+	} else {
+		parser->error = PARSE_BAD_CHARACTER;
+	}
+	return parser->error;
+}
+
+int parse_end(TimeoutParser *parser) {
+	// The line is complete. Errors found here are reported one column past its end.
+	if (parser->error != PARSE_OK) {
+		return parser->error;
+	}
+	parser->column++;
+	parser->error = parse_value_end(parser);
+	if (parser->error == PARSE_OK && parser->count < PARSE_VALUES) {
+		parser->error = PARSE_TOO_FEW;
+	}
+	return parser->error;
+}
+
+int parse_line(TimeoutParser *parser, const char *line, int length) {
+	// Parse a whole line, stopping at the first error.
+	int i;
+
+	parse_init(parser);
+	for (i = 0; i < length; i++) {
+		if (parse_byte(parser, line[i]) != PARSE_OK) {
+			return parser->error;
+		}
+	}
+	return parse_end(parser);
+}
+
+const char *parse_error(int error) {
+	if (error < 0 || error > PARSE_TOO_FEW) {
+		return "unknown error";
+	}
+	return error_names[error];
+}
+
+static int reference_parse(char *line, alt_u32 *values) {
+	// The strtok and atoi parse this replaced, without its printfs, for comparison.
+	char *token = strtok(line, ",");
+	int count = 0;
+
+	while (token != NULL) {
+		int value = atoi(token);
+		if (count >= PARSE_VALUES || value <= 0 || value >= 9999) {
+			return 0;
+		}
+		values[count++] = value;
+		token = strtok(NULL, ",");
+	}
+	return count == PARSE_VALUES;
+}
+
+void parse_bench(FILE *out, const char *args) {
+	// Time both parsers on a typical line.
+	static const char sample[] = "500,6000,2000,500,6000,2000";
+	const int rounds = 100;
+	TimeoutParser parser;
+	alt_u32 values[PARSE_VALUES];
+	char copy[sizeof(sample)];
+	alt_u32 start;
+	alt_u32 reference;
+	alt_u32 single;
+	int i;
+
+	start = capture_now();
+	for (i = 0; i < rounds; i++) {
+		memcpy(copy, sample, sizeof(sample)); // strtok writes into the line.
+		reference_parse(copy, values);
+	}
+	reference = capture_now() - start;
+
+	start = capture_now();
+	for (i = 0; i < rounds; i++) {
+		parse_line(&parser, sample, sizeof(sample) - 1);
+	}
+	single = capture_now() - start;
+
+	fprintf(out, "Timer ticks per line (%lu Hz): strtok/atoi %lu, single pass %lu\n\r",
+			alt_timestamp_freq(), reference / rounds, single / rounds);
+}
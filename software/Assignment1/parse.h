@@ -0,0 +1,44 @@
+#ifndef PARSE_H_
+#define PARSE_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Single pass parser for a line of timeouts, "t0,t1,t2,t3,t4,t5" in ms. Bytes
+// are checked as they are fed in, so the first bad one is reported with its
+// column. Only digits and commas are accepted, and each value must be 1..9998
+// with at most four digits. The parser keeps all of its state in the
+// TimeoutParser and does no stdio, heap or library calls, so it is reentrant
+// and leaves the input alone. There is no hardware divide and multiplication
+// may be emulated, so values are built up with shifts and adds.
+
+#define PARSE_VALUES 6
+#define PARSE_MAX_DIGITS 4
+#define PARSE_MAX_VALUE 9998
+
+// Errors. Once set, an error sticks until parse_init().
+#define PARSE_OK 0
+#define PARSE_BAD_CHARACTER 1 // Not a digit or a comma.
+#define PARSE_EMPTY_VALUE 2   // A comma with no digits before it, or nothing after the last one.
+#define PARSE_TOO_LONG 3      // More than PARSE_MAX_DIGITS digits.
+#define PARSE_OUT_OF_RANGE 4  // 0, or above PARSE_MAX_VALUE.
+#define PARSE_TOO_MANY 5      // More than PARSE_VALUES values.
+#define PARSE_TOO_FEW 6
+
+typedef struct {
+	alt_u32 values[PARSE_VALUES];
+	int count;    // Values completed.
+	alt_u32 value; // The value being read.
+	int digits;
+	int column;   // 1 based column of the last byte fed in.
+	int error;
+} TimeoutParser;
+
+void parse_init(TimeoutParser *parser);
+int parse_byte(TimeoutParser *parser, char c);
+int parse_end(TimeoutParser *parser);
+int parse_line(TimeoutParser *parser, const char *line, int length);
+const char *parse_error(int error);
+void parse_bench(FILE *out, const char *args);
+
+#endif /* PARSE_H_ */
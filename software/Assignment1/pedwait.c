@@ -0,0 +1,113 @@
+#include <string.h>
+#include "pedwait.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_alarm.h"
+
+void pedwait_init(PedWait *pedwait) {
+	memset(pedwait, 0, sizeof(*pedwait));
+}
+
+void pedwait_clear(PedWait *pedwait) {
+	// Drop the waiting requests, as when the mode changes. The statistics are kept.
+	pedwait->waiting[PED_EW] = 0;
+	pedwait->waiting[PED_NS] = 0;
+}
+
+int pedwait_press(PedWait *pedwait, int crossing, alt_u32 now) {
+	// Called from the button ISR. Returns 1 if the press started a new request.
+	// Further presses while waiting do not restart the clock.
+	if (pedwait->waiting[crossing]) {
+		return 0;
+	}
+	pedwait->waiting[crossing] = 1;
+	pedwait->pressed[crossing] = now;
+	return 1;
+}
+
+void pedwait_served(PedWait *pedwait, int crossing, alt_u32 now) {
+	// Called from the alarm callback as the walk light comes on.
+	alt_u32 wait;
+	alt_u32 bucket;
+
+	if (!pedwait->waiting[crossing]) {
+		return;
+	}
+	pedwait->waiting[crossing] = 0;
+	wait = now - pedwait->pressed[crossing];
+	bucket = wait / alt_ticks_per_second();
+	if (bucket >= PEDWAIT_BUCKETS) {
+		bucket = PEDWAIT_BUCKETS - 1;
+	}
+	pedwait->histogram[bucket]++;
+	pedwait->served++;
+	pedwait->wait_total += wait;
+	if (wait > pedwait->wait_max) {
+		pedwait->wait_max = wait;
+	}
+}
+
+int pedwait_percentile(const PedWait *pedwait, int percent) {
+	// Returns the wait, in whole seconds, that "percent" of requests were served
+	// within. This is the upper edge of the bucket the percentile falls in, or
+	// PEDWAIT_BUCKETS for the last bucket, which has no upper edge.
+	alt_u32 total = 0;
+	alt_u32 needed;
+	int bucket;
+
+	for (bucket = 0; bucket < PEDWAIT_BUCKETS; bucket++) {
+		total += pedwait->histogram[bucket];
+	}
+	needed = (total * percent + 99) / 100;
+	total = 0;
+	for (bucket = 0; bucket < PEDWAIT_BUCKETS; bucket++) {
+		total += pedwait->histogram[bucket];
+		if (total >= needed && total > 0) {
+			return bucket + 1;
+		}
+	}
+	return 0;
+}
+
+static void pedwait_print_percentile(FILE *out, const PedWait *pedwait, int percent) {
+	// A percentile in the last bucket is only known to be at least its lower edge.
+	int seconds = pedwait_percentile(pedwait, percent);
+	if (seconds >= PEDWAIT_BUCKETS) {
+		fprintf(out, ", p%d >=%d s", percent, PEDWAIT_BUCKETS - 1);
+	} else {
+		fprintf(out, ", p%d <%d s", percent, seconds);
+	}
+}
+
+void pedwait_report(FILE *out, PedWait *pedwait) {
+	// Copy with interrupts disabled, since the ISRs update it.
+	static PedWait copy;
+	alt_u32 second = alt_ticks_per_second();
+	int bucket;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *pedwait;
+	alt_irq_enable_all(context);
+
+	if (copy.max_wait) {
+		fprintf(out, "Max wait policy %lu s, greens cut short %lu\n\r", copy.max_wait / second, copy.shortened);
+	} else {
+		fprintf(out, "Max wait policy off\n\r");
+	}
+	fprintf(out, "Served %lu, waiting EW %d NS %d\n\r", copy.served, copy.waiting[PED_EW], copy.waiting[PED_NS]);
+	if (copy.served == 0) {
+		return;
+	}
+	fprintf(out, "Wait mean %lu ms, max %lu ms",
+			copy.wait_total / copy.served * 1000 / second, copy.wait_max * 1000 / second);
+	pedwait_print_percentile(out, &copy, 50);
+	pedwait_print_percentile(out, &copy, 95);
+	pedwait_print_percentile(out, &copy, 99);
+	fprintf(out, "\n\r");
+	// Non-empty buckets, as seconds:count.
+	fprintf(out, " ");
+	for (bucket = 0; bucket < PEDWAIT_BUCKETS; bucket++) {
+		if (copy.histogram[bucket]) {
+			fprintf(out, " %d:%lu", bucket, copy.histogram[bucket]);
+		}
+	}
+	fprintf(out, "\n\r");
+}
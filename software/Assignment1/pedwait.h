@@ -0,0 +1,37 @@
+#ifndef PEDWAIT_H_
+#define PEDWAIT_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Pedestrian wait accounting. Each button press that starts a request is
+// timestamped, and the wait until the walk light comes on is recorded in a
+// histogram of one second buckets. An optional max wait policy cuts the
+// conflicting green short when a request would otherwise wait too long.
+
+#define PED_EW 0
+#define PED_NS 1
+#define PED_CROSSINGS 2
+
+#define PEDWAIT_BUCKETS 64        // One second each. The last one also counts longer waits.
+#define PEDWAIT_MIN_GREEN 3000    // The policy never cuts a green shorter than this, in ticks.
+
+typedef struct {
+	alt_u32 pressed[PED_CROSSINGS]; // Tick the waiting request was made.
+	alt_u8 waiting[PED_CROSSINGS];
+	alt_u32 max_wait;               // Policy limit in ticks, or 0 for off.
+	alt_u32 served;                 // Requests served.
+	alt_u32 wait_max;               // Longest wait, in ticks.
+	alt_u32 wait_total;             // Sum of the waits, in ticks.
+	alt_u32 shortened;              // Conflicting greens cut short by the policy.
+	alt_u32 histogram[PEDWAIT_BUCKETS];
+} PedWait;
+
+void pedwait_init(PedWait *pedwait);
+void pedwait_clear(PedWait *pedwait);
+int pedwait_press(PedWait *pedwait, int crossing, alt_u32 now);
+void pedwait_served(PedWait *pedwait, int crossing, alt_u32 now);
+int pedwait_percentile(const PedWait *pedwait, int percent);
+void pedwait_report(FILE *out, PedWait *pedwait);
+
+#endif /* PEDWAIT_H_ */
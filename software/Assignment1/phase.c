@@ -0,0 +1,89 @@
+#include "phase.h"
+#include "capture.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
+
+alt_u32 phase_start(PhaseClock *phase, alt_u32 first_interval) {
+	// Anchor a new plan at the current tick. Returns the absolute tick of the
+	// first transition, to pass to alt_alarm_start_at().
+	phase->epoch = alt_nticks();
+	phase->deadline = phase->epoch + first_interval;
+	phase->interval = first_interval;
+	phase->have_stamp = 0;
+	phase->transitions = 0;
+	phase->lateness = 0;
+	phase->lateness_max = 0;
+	phase->jitter_max = 0;
+	phase->lateness_sum = 0;
+	phase->shortened = 0;
+	phase->extended = 0;
+	return phase->deadline;
+}
+
+alt_u32 phase_transition(PhaseClock *phase, alt_u32 interval) {
+	// Called from the alarm callback as each transition runs, with the length
+	// of the state just entered. Records how late the transition ran and plans
+	// the next one. Returns the value for the callback to return, which the
+	// alarm adds to the tick it was due rather than the tick it ran.
+	alt_u32 stamp = capture_now();
+	alt_32 lateness = (alt_32) (alt_nticks() - phase->deadline);
+	alt_u32 jitter;
+	alt_u32 planned_us;
+
+	phase->lateness = lateness;
+	if (lateness > phase->lateness_max) {
+		phase->lateness_max = lateness;
+	}
+	phase->lateness_sum += lateness;
+
+	if (phase->have_stamp) {
+		// Compare the measured and planned interval at timestamp resolution.
+		jitter = capture_ticks_to_us(stamp - phase->last_stamp);
+		planned_us = phase->interval * (1000000 / alt_ticks_per_second());
+		jitter = jitter > planned_us ? jitter - planned_us : planned_us - jitter;
+		if (jitter > phase->jitter_max) {
+			phase->jitter_max = jitter;
+		}
+	}
+	phase->last_stamp = stamp;
+	phase->have_stamp = 1;
+
+	phase->transitions++;
+	phase->interval = interval;
+	phase->deadline += interval;
+	return interval;
+}
+
+alt_u32 phase_shorten(PhaseClock *phase, alt_u32 deadline) {
+	// End the current state early, at "deadline", which must be after now and
+	// before the planned transition. The caller restarts the alarm at the
+	// returned tick. Called with interrupts disabled, or from an ISR.
+	phase->interval -= phase->deadline - deadline;
+	phase->deadline = deadline;
+	phase->shortened++;
+	return deadline;
+}
+
+alt_u32 phase_extend(PhaseClock *phase, alt_u32 deadline) {
+	// End the current state later, at "deadline", which must be after the planned
+	// transition. The caller restarts the alarm at the returned tick.
+	phase->interval += deadline - phase->deadline;
+	phase->deadline = deadline;
+	phase->extended++;
+	return deadline;
+}
+
+void phase_report(FILE *out, PhaseClock *phase) {
+	// Copy with interrupts disabled, since the alarm callback updates it.
+	PhaseClock copy;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *phase;
+	alt_irq_enable_all(context);
+
+	fprintf(out, "Transitions %lu, next at tick %lu (epoch %lu)\n\r",
+			copy.transitions, copy.deadline, copy.epoch);
+	fprintf(out, "Lateness last %ld max %ld ticks, jitter max %lu us\n\r",
+			copy.lateness, copy.lateness_max, copy.jitter_max);
+	fprintf(out, "Lateness total %ld ticks\n\r", copy.lateness_sum);
+	fprintf(out, "States shortened %lu, extended %lu\n\r", copy.shortened, copy.extended);
+}
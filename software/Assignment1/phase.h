@@ -0,0 +1,33 @@
+#ifndef PHASE_H_
+#define PHASE_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Absolute deadline phase scheduling. Every state transition is planned as a
+// system clock tick relative to the cycle epoch, rather than as a delay from
+// whenever the last transition happened to run. ISR overruns therefore show
+// up as lateness on one transition instead of shifting every later one.
+
+typedef struct {
+	alt_u32 epoch;        // Tick the plan is anchored to.
+	alt_u32 deadline;     // Planned tick of the next transition.
+	alt_u32 interval;     // Planned length of the current state, in ticks.
+	alt_u32 last_stamp;   // Timestamp of the last transition, for sub-tick jitter.
+	int have_stamp;       // Set when last_stamp belongs to the previous transition.
+	alt_u32 transitions;  // Transitions run since phase_start().
+	alt_32 lateness;      // Actual minus planned tick of the last transition.
+	alt_32 lateness_max;  // Largest lateness seen.
+	alt_u32 jitter_max;   // Largest difference between actual and planned interval, in us.
+	alt_32 lateness_sum;  // Sum of lateness. What a relative scheduler would have drifted by.
+	alt_u32 shortened;    // States cut short by phase_shorten().
+	alt_u32 extended;     // States lengthened by phase_extend().
+} PhaseClock;
+
+alt_u32 phase_start(PhaseClock *phase, alt_u32 first_interval);
+alt_u32 phase_transition(PhaseClock *phase, alt_u32 interval);
+alt_u32 phase_shorten(PhaseClock *phase, alt_u32 deadline);
+alt_u32 phase_extend(PhaseClock *phase, alt_u32 deadline);
+void phase_report(FILE *out, PhaseClock *phase);
+
+#endif /* PHASE_H_ */
@@ -0,0 +1,46 @@
+#include "phase_table.h"
+
+// Fails to compile if a table does not have exactly PHASE_STATES rows.
+#define CHECK_ROWS(table) \
+	typedef char table##_has_wrong_row_count[(sizeof(table) / sizeof(table[0]) == PHASE_STATES) ? 1 : -1]
+
+// Mode 1. The lights cycle with no pedestrian crossings.
+static const PhaseRow simple_table[] = {
+	{SIG_NS_RED | SIG_EW_RED,    0, 0, 0, PHASE_SAFE},
+	{SIG_NS_GREEN | SIG_EW_RED,  1, 0, 0, 0},
+	{SIG_NS_YELLOW | SIG_EW_RED, 2, 0, 0, 0},
+	{SIG_NS_RED | SIG_EW_RED,    3, 0, 0, PHASE_SAFE},
+	{SIG_NS_RED | SIG_EW_GREEN,  4, 0, 0, 0},
+	{SIG_NS_RED | SIG_EW_YELLOW, 5, 0, 0, 0},
+};
+CHECK_ROWS(simple_table);
+
+// Modes 2 to 5. A waiting pedestrian walks alongside the parallel green and yellow.
+static const PhaseRow pedestrian_table[] = {
+	{SIG_NS_RED | SIG_EW_RED,    0, 0,           0,       PHASE_SAFE},
+	{SIG_NS_GREEN | SIG_EW_RED,  1, SIG_NS_WALK, WAIT_NS, PHASE_WALK_START},
+	{SIG_NS_YELLOW | SIG_EW_RED, 2, SIG_NS_WALK, 0,       PHASE_WALK_END},
+	{SIG_NS_RED | SIG_EW_RED,    3, 0,           0,       PHASE_SAFE},
+	{SIG_NS_RED | SIG_EW_GREEN,  4, SIG_EW_WALK, WAIT_EW, PHASE_WALK_START},
+	{SIG_NS_RED | SIG_EW_YELLOW, 5, SIG_EW_WALK, 0,       PHASE_WALK_END},
+};
+CHECK_ROWS(pedestrian_table);
+
+// Indexed by operating mode (1..5).
+static const PhaseRow *const mode_tables[] = {
+	simple_table, // Unused, modes start at 1.
+	simple_table,
+	pedestrian_table,
+	pedestrian_table,
+	pedestrian_table,
+	pedestrian_table,
+};
+
+#define NUMBER_OF_MODES ((int) (sizeof(mode_tables) / sizeof(mode_tables[0])))
+
+const PhaseRow *phase_table(int mode) {
+	if (mode < 0 || mode >= NUMBER_OF_MODES) {
+		mode = 1;
+	}
+	return mode_tables[mode];
+}
@@ -0,0 +1,42 @@
+#ifndef PHASE_TABLE_H_
+#define PHASE_TABLE_H_
+
+#include "alt_types.h"
+
+// Declarative description of each operating mode. Every mode is a table with
+// one row per fsm state, giving the signals to show, which timeout to use and
+// how pedestrian requests are served. The tables are const data, so stepping
+// the fsm is an indexed load and a PIO write. A new mode is a new table.
+
+#define PHASE_STATES 6 // Rows in every table. CurrentState counts 0..PHASE_STATES-1.
+
+// LEDS_GREEN bits.
+#define SIG_EW_GREEN  (1<<0)
+#define SIG_EW_YELLOW (1<<1)
+#define SIG_EW_RED    (1<<2)
+#define SIG_NS_GREEN  (1<<3)
+#define SIG_NS_YELLOW (1<<4)
+#define SIG_NS_RED    (1<<5)
+#define SIG_EW_WALK   (1<<6)
+#define SIG_NS_WALK   (1<<7)
+
+// LEDS_RED bits, lit while a pedestrian is waiting.
+#define WAIT_EW (1<<0)
+#define WAIT_NS (1<<1)
+
+// Row flags.
+#define PHASE_SAFE       (1<<0) // Red-red. Mode and timeout changes are allowed.
+#define PHASE_WALK_START (1<<1) // First state serving the crossing in "walk". Clears its wait light.
+#define PHASE_WALK_END   (1<<2) // Last state serving the crossing. The request is consumed.
+
+typedef struct {
+	alt_u8 signals; // LEDS_GREEN pattern without the walk lights.
+	alt_u8 timeout; // Index of the timeout value for this state.
+	alt_u8 walk;    // Walk light shown here if that crossing has a request waiting.
+	alt_u8 wait;    // LEDS_RED wait light cleared on PHASE_WALK_START.
+	alt_u8 flags;
+} PhaseRow;
+
+const PhaseRow *phase_table(int mode);
+
+#endif /* PHASE_TABLE_H_ */
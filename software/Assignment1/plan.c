@@ -0,0 +1,121 @@
+#include <sys/time.h>
+#include "plan.h"
+
+#define HOURS(h, m) ((h) * 60 + (m))
+
+// Default plans. The plan table is ordinary data in SDRAM, so it can be changed at run time.
+static const TimingPlan default_plans[] = {
+	{"AM peak",     HOURS(7, 0),  0, {500, 9000, 2000, 500, 5000, 2000}},
+	{"Midday",      HOURS(10, 0), 0, {500, 6000, 2000, 500, 6000, 2000}},
+	{"PM peak",     HOURS(16, 0), 0, {500, 5000, 2000, 500, 9000, 2000}},
+	{"Night flash", HOURS(22, 0), 1, {0, 0, 0, 0, 0, 0}},
+};
+
+#define DEFAULT_PLANS ((int) (sizeof(default_plans) / sizeof(default_plans[0])))
+
+void plan_init(PlanSchedule *schedule) {
+	int i;
+	for (i = 0; i < DEFAULT_PLANS; i++) {
+		schedule->plans[i] = default_plans[i];
+	}
+	schedule->count = DEFAULT_PLANS;
+	schedule->enabled = 0;
+	schedule->active = -1;
+	schedule->changes = 0;
+}
+
+int plan_for_minute(const PlanSchedule *schedule, int minute) {
+	// The last plan to start at or before "minute". Before the first plan of the
+	// day, the last plan of the previous day is still running.
+	int i;
+	int plan = schedule->count - 1;
+
+	for (i = 0; i < schedule->count; i++) {
+		if (schedule->plans[i].start <= minute) {
+			plan = i;
+		}
+	}
+	return plan;
+}
+
+const TimingPlan *plan_update(PlanSchedule *schedule) {
+	// Work out the plan for the current time. Run from the main loop once a second,
+	// since the division is too slow for the alarm callback. Returns the plan to
+	// load, or NULL if it has not changed.
+	struct timeval now;
+	int wanted;
+
+	if (!schedule->enabled || schedule->count == 0 || gettimeofday(&now, NULL) != 0) {
+		return NULL;
+	}
+	wanted = plan_for_minute(schedule, (now.tv_sec % (MINUTES_PER_DAY * 60)) / 60);
+	if (wanted == schedule->active) {
+		return NULL;
+	}
+	schedule->active = wanted;
+	schedule->changes++;
+	return &schedule->plans[wanted];
+}
+
+int plan_set(PlanSchedule *schedule, int index, const TimingPlan *plan) {
+	// Replace plan "index", or add a plan when "index" is the plan count. The
+	// plans must stay in order of start minute. Returns 0 if the plan does not fit.
+	if (index < 0 || index > schedule->count || index >= PLAN_MAX || plan->start >= MINUTES_PER_DAY) {
+		return 0;
+	}
+	if ((index > 0 && schedule->plans[index - 1].start >= plan->start) ||
+			(index + 1 < schedule->count && schedule->plans[index + 1].start <= plan->start)) {
+		return 0;
+	}
+	schedule->plans[index] = *plan;
+	if (index == schedule->count) {
+		schedule->count++;
+	}
+	if (index == schedule->active) {
+		schedule->active = -1; // Load the new timeouts on the next update.
+	}
+	return 1;
+}
+
+int plan_set_time(PlanSchedule *schedule, int hours, int minutes) {
+	// Set the wall clock to hours:minutes and start following the plans.
+	struct timeval now;
+	struct timezone zone = {0, 0};
+
+	if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+		return 0;
+	}
+	now.tv_sec = HOURS(hours, minutes) * 60;
+	now.tv_usec = 0;
+	if (settimeofday(&now, &zone) != 0) {
+		return 0;
+	}
+	schedule->enabled = 1;
+	return 1;
+}
+
+void plan_report(FILE *out, PlanSchedule *schedule) {
+	struct timeval now;
+	int i;
+	int j;
+
+	if (schedule->enabled && gettimeofday(&now, NULL) == 0) {
+		int minute = (now.tv_sec % (MINUTES_PER_DAY * 60)) / 60;
+		fprintf(out, "Time %02d:%02d, %lu plan changes\n\r", minute / 60, minute % 60, schedule->changes);
+	} else {
+		fprintf(out, "Clock not set, plans not running\n\r");
+	}
+	for (i = 0; i < schedule->count; i++) {
+		const TimingPlan *plan = &schedule->plans[i];
+		fprintf(out, "%c %02d:%02d %-12s", i == schedule->active ? '*' : ' ',
+				plan->start / 60, plan->start % 60, plan->name);
+		if (plan->flash) {
+			fprintf(out, " flash");
+		} else {
+			for (j = 0; j < PLAN_TIMEOUTS; j++) {
+				fprintf(out, " %u", plan->timeouts[j]);
+			}
+		}
+		fprintf(out, "\n\r");
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Time of day timing plans. Each plan gives the six timeouts (t0..t5) to run
+// from a minute of the day until the next plan starts, or flashes the lights
+// overnight. The main loop works out which plan the wall clock (gettimeofday)
+// calls for and publishes its timing (timing.h), which the alarm callback
+// swaps in at the next safe state. The intersection keeps running through
+// the change.
+//
+// The wall clock starts at midnight on reset, so scheduling only starts once
+// the time has been set ("time hh:mm" on the console).
+
+#define PLAN_MAX 8
+#define PLAN_TIMEOUTS 6
+#define MINUTES_PER_DAY (24 * 60)
+
+typedef struct {
+	const char *name;
+	alt_u16 start;                   // Minute of the day the plan starts.
+	alt_u8 flash;                    // Flash NS yellow and EW red instead of cycling.
+	alt_u16 timeouts[PLAN_TIMEOUTS]; // t0..t5, in ms.
+} TimingPlan;
+
+typedef struct {
+	TimingPlan plans[PLAN_MAX];     // In order of start minute.
+	int count;
+	int enabled;                    // Set once the wall clock has been set.
+	int active;                     // Plan last loaded, or -1.
+	alt_u32 changes;                // Plan changes made.
+} PlanSchedule;
+
+void plan_init(PlanSchedule *schedule);
+int plan_for_minute(const PlanSchedule *schedule, int minute);
+const TimingPlan *plan_update(PlanSchedule *schedule);
+int plan_set(PlanSchedule *schedule, int index, const TimingPlan *plan);
+int plan_set_time(PlanSchedule *schedule, int hours, int minutes);
+void plan_report(FILE *out, PlanSchedule *schedule);
+
+#endif /* PLAN_H_ */
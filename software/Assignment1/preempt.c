@@ -0,0 +1,79 @@
+#include <string.h>
+#include "preempt.h"
+#include "actuated.h"
+#include "sys/alt_irq.h"
+
+void preempt_init(Preempt *preempt) {
+	memset(preempt, 0, sizeof(*preempt));
+	preempt->call = -1;
+}
+
+int preempt_call(Preempt *preempt, int approach, alt_u32 now) {
+	// The switches now call "approach", or -1 for no call. Called from the poll
+	// alarm. Returns 1 if the call changed.
+	if (approach == preempt->call) {
+		return 0;
+	}
+	preempt->call = approach;
+	preempt->called_at = now;
+	preempt->reached = 0;
+	return 1;
+}
+
+int preempt_reached(Preempt *preempt, alt_u32 now, alt_u32 bound) {
+	// Called from the alarm callback as the called green is shown. The first time
+	// for each call, logs the latency and returns 1.
+	PreemptEvent *event;
+	alt_u32 latency = now - preempt->called_at;
+
+	if (preempt->reached) {
+		return 0;
+	}
+	preempt->reached = 1;
+	preempt->events++;
+	if (latency > preempt->latency_max) {
+		preempt->latency_max = latency;
+	}
+	if (latency > bound) {
+		preempt->late++;
+	}
+	event = &preempt->log[preempt->log_next];
+	event->approach = preempt->call;
+	event->latency = latency;
+	preempt->log_next = (preempt->log_next + 1) % PREEMPT_LOG;
+	return 1;
+}
+
+void preempt_report(FILE *out, Preempt *preempt, alt_u32 bound) {
+	// Copy with interrupts disabled, since the alarm callbacks update it.
+	Preempt copy;
+	int i;
+	int n;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *preempt;
+	alt_irq_enable_all(context);
+
+	fprintf(out, "Call %s, %lu events, latency max %lu ticks, bound %lu, over bound %lu\n\r",
+			copy.call < 0 ? "none" : (copy.call == APPROACH_NS ? "NS" : "EW"), copy.events, copy.latency_max, bound, copy.late);
+	// Oldest first.
+	n = copy.events < PREEMPT_LOG ? copy.events : PREEMPT_LOG;
+	for (i = 0; i < n; i++) {
+		PreemptEvent *event = &copy.log[(copy.log_next + PREEMPT_LOG - n + i) % PREEMPT_LOG];
+		fprintf(out, "  %s %lu\n\r", event->approach == APPROACH_NS ? "NS" : "EW", event->latency);
+	}
+}
+
+int preempt_events(Preempt *preempt, PreemptEvent *events) {
+	// Copy the logged events, oldest first, into "events" (PREEMPT_LOG long).
+	// Returns how many there are.
+	int i;
+	int n;
+	alt_irq_context context = alt_irq_disable_all();
+
+	n = preempt->events < PREEMPT_LOG ? preempt->events : PREEMPT_LOG;
+	for (i = 0; i < n; i++) {
+		events[i] = preempt->log[(preempt->log_next + PREEMPT_LOG - n + i) % PREEMPT_LOG];
+	}
+	alt_irq_enable_all(context);
+	return n;
+}
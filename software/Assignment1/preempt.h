@@ -0,0 +1,39 @@
+#ifndef PREEMPT_H_
+#define PREEMPT_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Emergency vehicle preemption. A call for an approach (switch 15 for NS,
+// switch 14 for EW) ends any conflicting green at once, runs its yellow and
+// red-red clearance, then gives the called approach green and holds it until
+// the call is dropped. The time from the call being seen to the called green
+// coming on is logged for every event.
+
+#define PREEMPT_POLL 10  // The switches have no interrupt, so they are polled every 10 ticks.
+#define PREEMPT_HOLD 1000 // Interval the called green is held for before it is checked again.
+#define PREEMPT_LOG 8    // Latest events kept for the console.
+
+typedef struct {
+	alt_u8 approach;
+	alt_u32 latency;      // Ticks from the call being seen to the called green.
+} PreemptEvent;
+
+typedef struct {
+	volatile int call;    // Approach called (APPROACH_EW / APPROACH_NS), or -1.
+	alt_u32 called_at;    // Tick the call was seen.
+	int reached;          // The called green is showing.
+	alt_u32 events;       // Calls that reached their green.
+	alt_u32 latency_max;
+	alt_u32 late;         // Events slower than the guaranteed bound.
+	PreemptEvent log[PREEMPT_LOG];
+	int log_next;
+} Preempt;
+
+void preempt_init(Preempt *preempt);
+int preempt_call(Preempt *preempt, int approach, alt_u32 now);
+int preempt_reached(Preempt *preempt, alt_u32 now, alt_u32 bound);
+void preempt_report(FILE *out, Preempt *preempt, alt_u32 bound);
+int preempt_events(Preempt *preempt, PreemptEvent *events);
+
+#endif /* PREEMPT_H_ */
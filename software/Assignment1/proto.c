@@ -0,0 +1,56 @@
+#include <string.h>
+#include "proto.h"
+
+void proto_init(Proto *proto) {
+	memset(proto, 0, sizeof(*proto));
+}
+
+int proto_add(Proto *proto, int type, ProtoHandler handler) {
+	// Register the handler for a message type. Returns 0 if the type is out of range.
+	if (type <= 0 || type >= PROTO_MAX_TYPES) {
+		return 0;
+	}
+	proto->handlers[type] = handler;
+	return 1;
+}
+
+void proto_input(Proto *proto, FILE *out, const alt_u8 *body, int length) {
+	// "body" is a record from the uart driver, without its leading zero.
+	alt_u8 message[FRAME_MAX_MESSAGE + 2];
+	alt_u8 reply[FRAME_MAX_MESSAGE];
+	int reply_length = 0;
+	int type;
+	int status;
+
+	length = frame_decode(message, body, length);
+	if (length < 0) {
+		proto->errors++; // The sequence number can't be trusted, so there is no reply.
+		return;
+	}
+	proto->frames++;
+	type = message[0];
+
+	if (proto->last_length > 0 && type == proto->last_type && message[1] == proto->last_sequence) {
+		proto->retries++;
+		fwrite(proto->last, 1, proto->last_length, out);
+		fflush(out);
+		return;
+	}
+	if (type <= 0 || type >= PROTO_MAX_TYPES || proto->handlers[type] == NULL) {
+		status = FRAME_UNKNOWN;
+	} else {
+		status = proto->handlers[type](&message[2], length - 2, &reply[3], &reply_length);
+	}
+	reply[0] = type | FRAME_REPLY;
+	reply[1] = message[1];
+	reply[2] = status;
+	proto->last_type = type;
+	proto->last_sequence = message[1];
+	proto->last_length = frame_encode(proto->last, reply, reply_length + 3);
+	fwrite(proto->last, 1, proto->last_length, out);
+	fflush(out); // The frame has no newline to flush the stream.
+}
+
+void proto_report(FILE *out, Proto *proto) {
+	fprintf(out, "Frames %lu, errors %lu, retries %lu\n\r", proto->frames, proto->errors, proto->retries);
+}
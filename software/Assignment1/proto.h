@@ -0,0 +1,37 @@
+#ifndef PROTO_H_
+#define PROTO_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+#include "frame.h"
+
+// Binary command protocol on the uart (see frame.h for the framing). The main
+// loop passes each binary record from the uart to proto_input(), which checks
+// it, runs the handler registered for its type and sends the reply. A request
+// repeating the sequence number and type of the last one is a retry after a
+// lost reply: the saved reply is sent again and the handler is not rerun.
+
+#define PROTO_MAX_TYPES 8
+#define PROTO_MAX_REPLY (FRAME_MAX_MESSAGE - 3) // After the type, sequence and status.
+
+// Handles the payload of a request. Writes up to PROTO_MAX_REPLY bytes of reply
+// data into "reply", sets "reply_length", and returns a FRAME_ status.
+typedef int (*ProtoHandler)(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length);
+
+typedef struct {
+	ProtoHandler handlers[PROTO_MAX_TYPES];
+	int last_type;                  // Type and sequence number of the last request.
+	int last_sequence;
+	alt_u8 last[FRAME_MAX_ENCODED]; // Its encoded reply, for retries.
+	int last_length;
+	alt_u32 frames;                 // Frames received.
+	alt_u32 errors;                 // Frames that failed their CRC or were malformed.
+	alt_u32 retries;                // Repeated requests answered from the saved reply.
+} Proto;
+
+void proto_init(Proto *proto);
+int proto_add(Proto *proto, int type, ProtoHandler handler);
+void proto_input(Proto *proto, FILE *out, const alt_u8 *body, int length);
+void proto_report(FILE *out, Proto *proto);
+
+#endif /* PROTO_H_ */
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "telemetry.h"
+#include "frame.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
+
+#define TELEMETRY_MASK (TELEMETRY_QUEUE - 1)
+
+static alt_alarm TelemetryTimer;
+
+void telemetry_init(Telemetry *telemetry, TelemetrySampler sampler, void *context) {
+	memset(telemetry, 0, sizeof(*telemetry));
+	telemetry->sampler = sampler;
+	telemetry->context = context;
+}
+
+static alt_u32 telemetry_timer_isr(void *context) {
+	// Take a sample, or count it as dropped if the main loop has not sent the
+	// queue yet. Nothing here waits, and the queue is never overwritten.
+	Telemetry *telemetry = (Telemetry*) context;
+	alt_u32 head = telemetry->head;
+
+	if (head - telemetry->tail >= TELEMETRY_QUEUE) {
+		telemetry->dropped++;
+	} else {
+		telemetry->sampler(&telemetry->queue[head & TELEMETRY_MASK], telemetry->context);
+		telemetry->head = head + 1;
+		telemetry->samples++;
+	}
+	return telemetry->period;
+}
+
+int telemetry_set_rate(Telemetry *telemetry, int rate) {
+	// Start the stream, change its rate, or stop it with a rate of 0. Returns 0
+	// if the rate is out of range.
+	if (rate < 0 || rate > TELEMETRY_MAX_RATE) {
+		return 0;
+	}
+	if (telemetry->rate != 0) {
+		alt_alarm_stop(&TelemetryTimer);
+	}
+	telemetry->rate = rate;
+	if (rate != 0) {
+		telemetry->period = alt_ticks_per_second() / rate;
+		alt_alarm_start(&TelemetryTimer, telemetry->period, telemetry_timer_isr, telemetry);
+	}
+	return 1;
+}
+
+int telemetry_drain(Telemetry *telemetry, FILE *out) {
+	// Send the queued samples. Run from the main loop, where a full uart
+	// transmit buffer holds the loop up rather than the alarm. Returns the
+	// number sent.
+	alt_u8 message[2 + TELEMETRY_RECORD];
+	alt_u8 frame[FRAME_MAX_ENCODED];
+	const TelemetrySample *sample;
+	alt_u32 remaining;
+	int sent = 0;
+
+	while (telemetry->tail != telemetry->head) {
+		sample = &telemetry->queue[telemetry->tail & TELEMETRY_MASK];
+		remaining = sample->remaining < 0x10000 ? sample->remaining * 1000 / alt_ticks_per_second() : 0xffff;
+		message[0] = FRAME_TELEMETRY;
+		message[1] = telemetry->sequence++;
+		frame_put32(&message[2], sample->tick);
+		message[6] = sample->mode;
+		message[7] = sample->state;
+		message[8] = sample->flags;
+		frame_put16(&message[9], remaining > 0xffff ? 0xffff : remaining);
+		frame_put16(&message[11], sample->detections[0]);
+		frame_put16(&message[13], sample->detections[1]);
+		frame_put16(&message[15], telemetry->dropped);
+		telemetry->tail++; // Copied out, so the alarm may reuse the slot.
+
+		fwrite(frame, 1, frame_encode(frame, message, sizeof(message)), out);
+		sent++;
+	}
+	if (sent != 0) {
+		telemetry->sent += sent;
+		fflush(out);
+	}
+	return sent;
+}
+
+void telemetry_report(FILE *out, Telemetry *telemetry) {
+	// Copy the counts with interrupts disabled, since the alarm updates them.
+	alt_u32 samples;
+	alt_u32 sent;
+	alt_u32 dropped;
+	alt_irq_context context = alt_irq_disable_all();
+	samples = telemetry->samples;
+	sent = telemetry->sent;
+	dropped = telemetry->dropped;
+	alt_irq_enable_all(context);
+
+	if (telemetry->rate == 0) {
+		fprintf(out, "Telemetry off");
+	} else {
+		fprintf(out, "Telemetry at %d Hz", telemetry->rate);
+	}
+	fprintf(out, ", %lu samples queued, %lu records sent, %lu dropped\n\r", samples, sent, dropped);
+}
@@ -0,0 +1,60 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Telemetry stream. An alarm samples the controller state at an operator set
+// rate (1..100 Hz) into a small queue, and the main loop sends each sample on
+// the uart as a FRAME_TELEMETRY frame (frame.h). The alarm only copies a few
+// words and never waits for the uart, so the signal timing is not disturbed.
+// If the main loop falls behind and the queue is full, the sample is dropped
+// and counted, and the count goes out in every record so the host can see
+// the gaps.
+//
+// Record payload, little endian (TELEMETRY_RECORD bytes):
+//     tick u32, mode u8, state u8, flags u8, remaining u16 (ms),
+//     EW detections u16, NS detections u16, dropped u16
+
+#define TELEMETRY_QUEUE 8 // Samples. Must be a power of two.
+#define TELEMETRY_MAX_RATE 100 // Hz.
+#define TELEMETRY_RECORD 15
+
+// Record flags.
+#define TELEMETRY_EW_PED 0x01    // EW pedestrian request waiting.
+#define TELEMETRY_NS_PED 0x02
+#define TELEMETRY_FLASHING 0x04
+#define TELEMETRY_PREEMPTED 0x08 // Emergency vehicle call active.
+
+typedef struct {
+	alt_u32 tick;
+	alt_u8 mode;
+	alt_u8 state;
+	alt_u8 flags;
+	alt_u32 remaining;     // Ticks to the next transition.
+	alt_u32 detections[2]; // Detector events so far, by approach.
+} TelemetrySample;
+
+// Fills in a sample. Called from the telemetry alarm.
+typedef void (*TelemetrySampler)(TelemetrySample *sample, void *context);
+
+typedef struct {
+	TelemetrySample queue[TELEMETRY_QUEUE];
+	volatile alt_u32 head;     // Next slot the alarm fills.
+	volatile alt_u32 tail;     // Next sample the main loop sends.
+	int rate;                  // Hz, or 0 when off.
+	alt_u32 period;            // Ticks between samples.
+	TelemetrySampler sampler;
+	void *context;
+	alt_u8 sequence;
+	volatile alt_u32 samples;  // Samples queued.
+	alt_u32 sent;
+	volatile alt_u32 dropped;  // Samples lost because the queue was full.
+} Telemetry;
+
+void telemetry_init(Telemetry *telemetry, TelemetrySampler sampler, void *context);
+int telemetry_set_rate(Telemetry *telemetry, int rate);
+int telemetry_drain(Telemetry *telemetry, FILE *out);
+void telemetry_report(FILE *out, Telemetry *telemetry);
+
+#endif /* TELEMETRY_H_ */
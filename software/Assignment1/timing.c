@@ -0,0 +1,65 @@
+#include <string.h>
+#include "timing.h"
+#include "sys/alt_irq.h"
+
+void timing_init(Timing *timing, const alt_u32 *timeouts) {
+	memset(timing, 0, sizeof(*timing));
+	memcpy(timing->sets[0].timeouts, timeouts, sizeof(timing->sets[0].timeouts));
+	timing->active = &timing->sets[0];
+	timing->pending = NULL;
+}
+
+TimingSet *timing_back(Timing *timing) {
+	// Returns the set not in use, to fill in from the main loop. A set published
+	// but not yet swapped in is withdrawn first, so the alarm callback cannot take
+	// it while it is being rewritten.
+	TimingSet *back;
+	alt_irq_context context = alt_irq_disable_all();
+
+	if (timing->pending != NULL) {
+		timing->pending = NULL;
+		timing->superseded++;
+	}
+	back = (timing->active == &timing->sets[0]) ? &timing->sets[1] : &timing->sets[0];
+	alt_irq_enable_all(context);
+	return back;
+}
+
+void timing_publish(Timing *timing, TimingSet *set) {
+	// Hand a filled in back set to the alarm callback.
+	set->version = ++timing->published;
+	timing->pending = set;
+}
+
+const TimingSet *timing_swap(Timing *timing) {
+	// Called from the alarm callback at a safe state. Returns the newly active set,
+	// or NULL if nothing was published.
+	TimingSet *pending = timing->pending;
+
+	if (pending == NULL) {
+		return NULL;
+	}
+	timing->active = pending;
+	timing->pending = NULL;
+	timing->swaps++;
+	return pending;
+}
+
+void timing_report(FILE *out, Timing *timing) {
+	// Copy with interrupts disabled, so the set and the pending flag agree.
+	TimingSet active;
+	int pending;
+	int i;
+	alt_irq_context context = alt_irq_disable_all();
+	active = *timing->active;
+	pending = timing->pending != NULL;
+	alt_irq_enable_all(context);
+
+	fprintf(out, "Timing version %lu%s:", active.version, active.flash ? " (flash)" : "");
+	for (i = 0; i < TIMING_VALUES; i++) {
+		fprintf(out, " %lu", active.timeouts[i]);
+	}
+	fprintf(out, "\n\r");
+	fprintf(out, "Published %lu, swapped in %lu, superseded %lu%s\n\r", timing->published,
+			timing->swaps, timing->superseded, pending ? ", one waiting for a safe state" : "");
+}
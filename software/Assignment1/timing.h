@@ -0,0 +1,36 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Double-buffered timing configuration. The alarm callback only ever reads the
+// active set. New timeouts are written into the other (back) set from the main
+// loop while traffic keeps running, then published. The alarm callback swaps
+// the published set in with one pointer write at the next safe state, so it
+// never sees a half-written set and the controller never has to stop.
+
+#define TIMING_VALUES 6 // t0..t5
+
+typedef struct {
+	alt_u32 version;                // Publication number, 0 for the initial set.
+	int flash;                      // Flash the lights instead of cycling.
+	alt_u32 timeouts[TIMING_VALUES]; // In ticks.
+} TimingSet;
+
+typedef struct {
+	TimingSet sets[2];
+	const TimingSet *volatile active;  // Read by the alarm callback.
+	TimingSet *volatile pending;       // Published and waiting for a safe state, or NULL.
+	alt_u32 published;                 // Sets published.
+	alt_u32 swaps;                     // Sets swapped in.
+	alt_u32 superseded;                // Published sets replaced before they were swapped in.
+} Timing;
+
+void timing_init(Timing *timing, const alt_u32 *timeouts);
+TimingSet *timing_back(Timing *timing);
+void timing_publish(Timing *timing, TimingSet *set);
+const TimingSet *timing_swap(Timing *timing);
+void timing_report(FILE *out, Timing *timing);
+
+#endif /* TIMING_H_ */
@@ -0,0 +1,76 @@
+#include "tlog.h"
+#include "sys/alt_irq.h"
+
+#define TLOG_MASK (TLOG_LENGTH - 1)
+
+typedef struct {
+	alt_u32 id;
+	alt_u32 args[TLOG_ARGS];
+} TlogRecord;
+
+static volatile TlogRecord Log[TLOG_LENGTH];
+static volatile alt_u32 Head = 0; // Next record to write. Only the producers change this.
+static volatile alt_u32 Tail = 0; // Next record to format. Only the main loop changes this.
+static const TlogMessage *Messages = 0;
+static int MessageCount = 0;
+static alt_u32 Reported = 0; // Drops already reported by the drain.
+volatile alt_u32 tlog_dropped = 0;
+
+void tlog_init(const TlogMessage *messages, int count) {
+	Messages = messages;
+	MessageCount = count;
+}
+
+int tlog_write(int id, alt_u32 arg0, alt_u32 arg1, alt_u32 arg2) {
+	// Record a message. Safe from any context. Returns 0 if the log is full.
+	alt_irq_context context = alt_irq_disable_all();
+	alt_u32 head = Head;
+	volatile TlogRecord *record;
+
+	if (head - Tail >= TLOG_LENGTH) {
+		tlog_dropped++;
+		alt_irq_enable_all(context);
+		return 0;
+	}
+	record = &Log[head & TLOG_MASK];
+	record->id = id;
+	record->args[0] = arg0;
+	record->args[1] = arg1;
+	record->args[2] = arg2;
+	Head = head + 1; // Publish the record only once it is complete.
+	alt_irq_enable_all(context);
+	return 1;
+}
+
+int tlog_drain(FILE *out) {
+	// Format every pending record. Called from the main loop. Returns the number formatted.
+	alt_u32 args[TLOG_ARGS];
+	alt_u32 tail = Tail;
+	alt_u32 dropped;
+	alt_u32 id;
+	int count = 0;
+
+	while (tail != Head) {
+		id = Log[tail & TLOG_MASK].id;
+		args[0] = Log[tail & TLOG_MASK].args[0];
+		args[1] = Log[tail & TLOG_MASK].args[1];
+		args[2] = Log[tail & TLOG_MASK].args[2];
+		Tail = ++tail; // Copied out, so the slot can be reused while formatting.
+
+		if (id >= (alt_u32) MessageCount) {
+			fprintf(out, "Log message %lu: %lu %lu %lu\n\r", id, args[0], args[1], args[2]);
+		} else {
+			if (Messages[id].convert != 0) {
+				Messages[id].convert(args);
+			}
+			fprintf(out, Messages[id].format, args[0], args[1], args[2]);
+		}
+		count++;
+	}
+	dropped = tlog_dropped;
+	if (dropped != Reported) {
+		fprintf(out, "(%lu log records dropped)\n\r", dropped - Reported);
+		Reported = dropped;
+	}
+	return count;
+}
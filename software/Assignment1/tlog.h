@@ -0,0 +1,39 @@
+#ifndef TLOG_H_
+#define TLOG_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+
+// Deferred formatting log. A caller records a message id and up to three raw
+// argument words, which takes a few dozen cycles and no stdio, so it can be
+// used from ISRs and alarm callbacks as well as the main loop. The main loop
+// drains the log and does the formatting with the message table given to
+// tlog_init(). Producers may preempt each other, so like workq_post()
+// recording briefly disables interrupts to reserve a slot; it never waits.
+// When the log is full the record is dropped and counted.
+
+#define TLOG_LENGTH 32 // Records. Must be a power of two.
+#define TLOG_ARGS 3
+
+// Turns the raw arguments into the ones the format expects, in place, for
+// work too slow to do when recording (divides, string lookups). Called from
+// the drain.
+typedef void (*TlogConvert)(alt_u32 *args);
+
+typedef struct {
+	const char *format; // printf format taking up to TLOG_ARGS alt_u32 (or pointer) arguments.
+	TlogConvert convert; // Or NULL.
+} TlogMessage;
+
+void tlog_init(const TlogMessage *messages, int count);
+int tlog_write(int id, alt_u32 arg0, alt_u32 arg1, alt_u32 arg2);
+int tlog_drain(FILE *out);
+
+#define tlog0(id) tlog_write((id), 0, 0, 0)
+#define tlog1(id, a) tlog_write((id), (a), 0, 0)
+#define tlog2(id, a, b) tlog_write((id), (a), (b), 0)
+#define tlog3(id, a, b, c) tlog_write((id), (a), (b), (c))
+
+extern volatile alt_u32 tlog_dropped; // Records lost because the log was full.
+
+#endif /* TLOG_H_ */
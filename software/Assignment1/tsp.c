@@ -0,0 +1,125 @@
+#include <string.h>
+#include "tsp.h"
+#include "sys/alt_irq.h"
+
+static const char *const outcome_names[] = {"extended", "early green", "not needed", "denied"};
+
+void tsp_init(Tsp *tsp) {
+	memset(tsp, 0, sizeof(*tsp));
+}
+
+static void tsp_log(Tsp *tsp, int approach, int outcome, alt_u32 saved) {
+	TspEvent *event = &tsp->log[tsp->log_next];
+	event->approach = approach;
+	event->outcome = outcome;
+	event->saved = saved;
+	tsp->log_next = (tsp->log_next + 1) % TSP_LOG;
+	tsp->logged++;
+	tsp->outcomes[outcome]++;
+	tsp->saved += saved;
+}
+
+static alt_u32 tsp_early(Tsp *tsp, int approach, alt_u32 arrival, const TspView *view) {
+	// The conflicting green is showing. End it so the bus's green starts as it
+	// arrives, within the limits. Returns the new end, or 0 for no change.
+	alt_u32 end = view->end - (view->next_green - arrival);
+
+	if ((alt_32) (view->next_green - arrival) <= 0) {
+		tsp_log(tsp, approach, TSP_NOT_NEEDED, 0);
+		return 0;
+	}
+	if ((alt_32) (end - (view->end - TSP_MAX_EARLY)) < 0) {
+		end = view->end - TSP_MAX_EARLY;
+	}
+	if ((alt_32) (end - (view->start + TSP_MIN_GREEN)) < 0) {
+		end = view->start + TSP_MIN_GREEN;
+	}
+	if ((alt_32) (end - view->end) >= 0) {
+		tsp_log(tsp, approach, TSP_DENIED, 0);
+		return 0;
+	}
+	tsp_log(tsp, approach, TSP_EARLY, view->end - end);
+	return end;
+}
+
+alt_u32 tsp_request(Tsp *tsp, int approach, alt_u32 now, const TspView *view) {
+	// A bus has checked in on "approach". Returns the new end of the state showing,
+	// or 0 to leave it. The caller only moves the end of a green.
+	alt_u32 arrival = now + TSP_ARRIVAL;
+	alt_u32 end;
+
+	tsp->pending[approach] = 0;
+	switch (view->where) {
+	case TSP_GREEN:
+		end = arrival + TSP_CLEAR;
+		if ((alt_32) (end - view->end) <= 0) {
+			tsp_log(tsp, approach, TSP_NOT_NEEDED, 0);
+			return 0;
+		}
+		if (end - view->end > TSP_MAX_EXTEND) {
+			tsp_log(tsp, approach, TSP_DENIED, 0);
+			return 0;
+		}
+		// Without the extension the bus would have waited for the next green.
+		tsp_log(tsp, approach, TSP_EXTENDED, view->next_green - arrival);
+		return end;
+	case TSP_CONFLICT:
+		return tsp_early(tsp, approach, arrival, view);
+	case TSP_CLEARING:
+		// Nothing can be shortened before the bus's green.
+		tsp_log(tsp, approach, (alt_32) (view->next_green - arrival) <= 0 ? TSP_NOT_NEEDED : TSP_DENIED, 0);
+		return 0;
+	default:
+		tsp->pending[approach] = 1;
+		tsp->arrival[approach] = arrival;
+		return 0;
+	}
+}
+
+alt_u32 tsp_conflict_start(Tsp *tsp, int approach, const TspView *view) {
+	// Called from the alarm callback as the green conflicting with "approach"
+	// starts. A bus held over on "approach" gets an early green. Returns the new
+	// end of the conflicting green, or 0 to leave it.
+	if (!tsp->pending[approach]) {
+		return 0;
+	}
+	tsp->pending[approach] = 0;
+	return tsp_early(tsp, approach, tsp->arrival[approach], view);
+}
+
+void tsp_report(FILE *out, Tsp *tsp) {
+	// Copy with interrupts disabled, since the ISRs update it.
+	static Tsp copy;
+	int i;
+	int n;
+	alt_irq_context context = alt_irq_disable_all();
+	copy = *tsp;
+	alt_irq_enable_all(context);
+
+	fprintf(out, "Extended %lu, early green %lu, not needed %lu, denied %lu, held over %d\n\r",
+			copy.outcomes[TSP_EXTENDED], copy.outcomes[TSP_EARLY], copy.outcomes[TSP_NOT_NEEDED],
+			copy.outcomes[TSP_DENIED], copy.pending[0] + copy.pending[1]);
+	fprintf(out, "Bus delay saved %lu ticks\n\r", copy.saved);
+	// Oldest first.
+	n = copy.logged < TSP_LOG ? copy.logged : TSP_LOG;
+	for (i = 0; i < n; i++) {
+		TspEvent *event = &copy.log[(copy.log_next + TSP_LOG - n + i) % TSP_LOG];
+		fprintf(out, "  %s %s, saved %lu\n\r", event->approach == APPROACH_NS ? "NS" : "EW",
+				outcome_names[event->outcome], event->saved);
+	}
+}
+
+int tsp_events(Tsp *tsp, TspEvent *events) {
+	// Copy the logged requests, oldest first, into "events" (TSP_LOG long).
+	// Returns how many there are.
+	int i;
+	int n;
+	alt_irq_context context = alt_irq_disable_all();
+
+	n = tsp->logged < TSP_LOG ? tsp->logged : TSP_LOG;
+	for (i = 0; i < n; i++) {
+		events[i] = tsp->log[(tsp->log_next + TSP_LOG - n + i) % TSP_LOG];
+	}
+	alt_irq_enable_all(context);
+	return n;
+}
@@ -0,0 +1,64 @@
+#ifndef TSP_H_
+#define TSP_H_
+
+#include <stdio.h>
+#include "alt_types.h"
+#include "actuated.h"
+
+// Transit signal priority. A bus checking in upstream (switch 13 for NS,
+// switch 12 for EW) is expected at the stop line TSP_ARRIVAL ticks later.
+// If its green would end before then, the green is extended; if it would
+// arrive on red, the conflicting green is ended early. Both are limited, and
+// the cycle order and safe states are unchanged. A bus that checks in just
+// after its green has ended is held over to the next conflicting green,
+// which is ended early for it.
+
+#define TSP_ARRIVAL 5000     // Ticks from check in to the stop line.
+#define TSP_CLEAR 1000       // Green kept after the bus reaches the stop line.
+#define TSP_MAX_EXTEND 8000  // Longest green extension.
+#define TSP_MAX_EARLY 8000   // Most a conflicting green is cut short by.
+#define TSP_MIN_GREEN 3000   // A conflicting green is never cut shorter than this.
+#define TSP_LOG 8
+
+// Where the bus's approach is in the cycle.
+#define TSP_GREEN 0     // Its green is showing.
+#define TSP_CONFLICT 1  // The conflicting green is showing.
+#define TSP_CLEARING 2  // Yellow or red-red before its green.
+#define TSP_MISSED 3    // Its own yellow or red-red, after its green.
+
+// Request outcomes.
+#define TSP_EXTENDED 0
+#define TSP_EARLY 1
+#define TSP_NOT_NEEDED 2
+#define TSP_DENIED 3
+
+typedef struct {
+	int where;          // TSP_GREEN etc.
+	alt_u32 start;      // Tick the state showing started.
+	alt_u32 end;        // Tick it is planned to end.
+	alt_u32 next_green; // Tick the bus's green next starts, without priority.
+} TspView;
+
+typedef struct {
+	alt_u8 approach;
+	alt_u8 outcome;
+	alt_u32 saved;      // Estimated bus delay saved, in ticks.
+} TspEvent;
+
+typedef struct {
+	int pending[APPROACHES];      // Held over to the next conflicting green.
+	alt_u32 arrival[APPROACHES];  // Expected stop line tick of the pending bus.
+	alt_u32 outcomes[4];          // Requests by outcome.
+	alt_u32 saved;                // Total estimated bus delay saved, in ticks.
+	TspEvent log[TSP_LOG];
+	int log_next;
+	alt_u32 logged;
+} Tsp;
+
+void tsp_init(Tsp *tsp);
+alt_u32 tsp_request(Tsp *tsp, int approach, alt_u32 now, const TspView *view);
+alt_u32 tsp_conflict_start(Tsp *tsp, int approach, const TspView *view);
+void tsp_report(FILE *out, Tsp *tsp);
+int tsp_events(Tsp *tsp, TspEvent *events);
+
+#endif /* TSP_H_ */
@@ -0,0 +1,43 @@
+#include "workq.h"
+#include "sys/alt_irq.h"
+
+typedef struct {
+	WorkHandler handler;
+	alt_u32 arg;
+} WorkItem;
+
+static volatile WorkItem Queue[WORKQ_LENGTH];
+static volatile alt_u32 Head = 0; // Next slot to write. Only the producers (ISRs) change this.
+static volatile alt_u32 Tail = 0; // Next slot to read. Only the consumer (main loop) changes this.
+volatile alt_u32 workq_dropped = 0;
+
+int workq_post(WorkHandler handler, alt_u32 arg) {
+	// Add a work item. Called from interrupt context. Returns 0 if the queue is full.
+	// Interrupts are disabled so a higher priority ISR can't post into the same slot.
+	alt_irq_context context = alt_irq_disable_all();
+	alt_u32 head = Head;
+	if (head - Tail >= WORKQ_LENGTH) {
+		workq_dropped++;
+		alt_irq_enable_all(context);
+		return 0;
+	}
+	Queue[head & (WORKQ_LENGTH - 1)].handler = handler;
+	Queue[head & (WORKQ_LENGTH - 1)].arg = arg;
+	Head = head + 1; // Publish the item only once it is complete.
+	alt_irq_enable_all(context);
+	return 1;
+}
+
+int workq_drain(void) {
+	// Run every pending work item. Called from the main loop. Returns the number of items run.
+	int count = 0;
+	alt_u32 tail = Tail;
+	while (tail != Head) {
+		WorkHandler handler = Queue[tail & (WORKQ_LENGTH - 1)].handler;
+		alt_u32 arg = Queue[tail & (WORKQ_LENGTH - 1)].arg;
+		Tail = ++tail; // Free the slot before running, the handler may take a while.
+		handler(arg);
+		count++;
+	}
+	return count;
+}
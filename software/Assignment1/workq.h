@@ -0,0 +1,20 @@
+#ifndef WORKQ_H_
+#define WORKQ_H_
+
+#include "alt_types.h"
+
+// Deferred work queue. ISRs post small work items and the main loop runs them,
+// so slow work (stdio, LCD writes) never runs in interrupt context.
+// The main loop is the single consumer. ISRs may preempt each other, so
+// posting briefly disables interrupts to reserve a slot.
+
+#define WORKQ_LENGTH 16 // Number of pending items. Must be a power of two.
+
+typedef void (*WorkHandler)(alt_u32 arg);
+
+int workq_post(WorkHandler handler, alt_u32 arg);
+int workq_drain(void);
+
+extern volatile alt_u32 workq_dropped; // Items lost because the queue was full.
+
+#endif /* WORKQ_H_ */
@@ -66,11 +66,27 @@ struct alt_alarm_s
                           * zero indicates that the alarm should be removed 
                           * from the list. 
                           */
-  alt_u8 rollover;       /* set when desired alarm time + current time causes
-                            overflow, to prevent premature alarm */
   void* context;         /* Argument for the callback */
 };
 
+/*
+ * Registered alarms are held in a hierarchical timing wheel. Each level
+ * contains ALT_ALARM_WHEEL_SLOTS list heads, and each slot on level "n" spans
+ * ALT_ALARM_WHEEL_SLOTS^n system clock ticks. An alarm is filed on the lowest
+ * level whose span covers its remaining time, and is moved down a level each
+ * time the level below wraps ("cascades"). This makes starting, stopping and
+ * expiring an alarm constant time, regardless of how many alarms are
+ * registered.
+ *
+ * Six levels of 64 slots are sufficient to cover the full 32 bit tick range.
+ */
+
+#define ALT_ALARM_WHEEL_BITS   6
+#define ALT_ALARM_WHEEL_SLOTS  (1 << ALT_ALARM_WHEEL_BITS)
+#define ALT_ALARM_WHEEL_MASK   (ALT_ALARM_WHEEL_SLOTS - 1)
+#define ALT_ALARM_WHEEL_LEVELS ((32 + ALT_ALARM_WHEEL_BITS - 1) / \
+                                ALT_ALARM_WHEEL_BITS)
+
 /*
  * "_alt_tick_rate" is a global variable used to store the system clock rate 
  * in ticks per second. This is initialised to zero, which coresponds to there
@@ -90,9 +106,35 @@ extern alt_u32 _alt_tick_rate;
 
 extern volatile alt_u32 _alt_nticks;
 
-/* The list of registered alarms. */
+/*
+ * alt_alarm_wheel_insert() files an alarm, whose "time" member has already
+ * been set, into the timing wheel. It must be called with interrupts
+ * disabled.
+ */
+
+extern void alt_alarm_wheel_insert (struct alt_alarm_s* alarm);
+
+/*
+ * alt_alarm_next_tick() returns the number of ticks, between 1 and "limit",
+ * until the registered alarms next need to be processed. It is used by the
+ * system clock driver when ALT_SYS_CLK_TICKLESS is defined.
+ */
+
+extern alt_u32 alt_alarm_next_tick (alt_u32 limit);
+
+#ifdef ALT_SYS_CLK_TICKLESS
+
+/*
+ * A tickless system clock driver provides alt_sysclk_nticks(), which returns
+ * the tick count including any time elapsed since the last interrupt, and
+ * alt_sysclk_resync(), which reprograms the timer after an alarm has been
+ * registered. alt_sysclk_resync() must be called with interrupts disabled.
+ */
+
+extern alt_u32 alt_sysclk_nticks (void);
+extern void    alt_sysclk_resync (void);
 
-extern alt_llist alt_alarm_list;
+#endif /* ALT_SYS_CLK_TICKLESS */
 
 #ifdef __cplusplus
 }
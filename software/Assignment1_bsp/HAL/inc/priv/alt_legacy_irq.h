@@ -69,11 +69,18 @@ static ALT_INLINE int ALT_ALWAYS_INLINE alt_irq_disable (alt_u32 id)
 {
   alt_irq_context  status;
   extern volatile alt_u32 alt_irq_active;
+#ifdef ALT_IRQ_NESTING
+  extern volatile alt_u32 alt_priority_mask;
+#endif
 
   status = alt_irq_disable_all ();
 
   alt_irq_active &= ~(1 << id);
+#ifdef ALT_IRQ_NESTING
+  NIOS2_WRITE_IENABLE (alt_irq_active & alt_priority_mask);
+#else
   NIOS2_WRITE_IENABLE (alt_irq_active);
+#endif
 
   alt_irq_enable_all(status);
 
@@ -87,11 +94,19 @@ static ALT_INLINE int ALT_ALWAYS_INLINE alt_irq_enable (alt_u32 id)
 {
   alt_irq_context  status;
   extern volatile alt_u32 alt_irq_active;
+#ifdef ALT_IRQ_NESTING
+  extern volatile alt_u32 alt_priority_mask;
+#endif
 
   status = alt_irq_disable_all ();
 
   alt_irq_active |= (1 << id);
+#ifdef ALT_IRQ_NESTING
+  /* don't unmask interrupts of lower priority than a running handler */
+  NIOS2_WRITE_IENABLE (alt_irq_active & alt_priority_mask);
+#else
   NIOS2_WRITE_IENABLE (alt_irq_active);
+#endif
 
   alt_irq_enable_all(status);
 
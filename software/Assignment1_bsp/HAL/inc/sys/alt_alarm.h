@@ -69,6 +69,17 @@ extern int alt_alarm_start (alt_alarm* the_alarm,
                             alt_u32    (*callback) (void* context),
                             void*      context);
 
+/*
+ * alt_alarm_start_at() registers a callback to run when the system clock tick
+ * count reaches "time", rather than after a delay. It allows alarms to be 
+ * scheduled against absolute deadlines.
+ */
+
+extern int alt_alarm_start_at (alt_alarm* the_alarm,
+                               alt_u32    time,
+                               alt_u32    (*callback) (void* context),
+                               void*      context);
+
 /*
  * alt_alarm_stop() is used to unregister a callback. Alternatively the callback 
  * can return zero to unregister.
@@ -105,19 +116,29 @@ static ALT_INLINE int ALT_ALWAYS_INLINE alt_sysclk_init (alt_u32 nticks)
 
 /*
  * alt_nticks() returns the elapsed number of system clock ticks since reset.
+ * When the system clock is tickless, the count is brought up to date from the
+ * timer itself.
  */
 
 static ALT_INLINE alt_u32 ALT_ALWAYS_INLINE alt_nticks (void)
 {
+#ifdef ALT_SYS_CLK_TICKLESS
+  return alt_sysclk_nticks ();
+#else
   return _alt_nticks;
+#endif
 }
 
 /*
  * alt_tick() should only be called by the system clock driver. This is used
  * to notify the system that the system timer period has expired.
+ *
+ * alt_tick_advance() is used instead by a tickless system clock driver, to
+ * notify the system that "nticks" timer periods have expired.
  */
 
 extern void alt_tick (void);
+extern void alt_tick_advance (alt_u32 nticks);
 
 #ifdef __cplusplus
 }
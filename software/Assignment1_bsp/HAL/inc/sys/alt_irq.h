@@ -236,6 +236,24 @@ static ALT_INLINE alt_u32 ALT_ALWAYS_INLINE alt_irq_pending (void)
 
   return active;
 }
+
+#ifdef ALT_IRQ_NESTING
+/*
+ * When ALT_IRQ_NESTING is defined, alt_irq_handler() runs each interrupt 
+ * handler with interrupts enabled, so that it can be preempted by any 
+ * interrupt of higher priority. alt_irq_priority_set() assigns the priority
+ * of an interrupt; zero is the highest. By default the priority of each 
+ * interrupt is its interrupt number, which is also the order the hardware 
+ * gives them. Interrupts of equal priority do not preempt each other.
+ *
+ * Handlers which share data with another handler must protect it using 
+ * alt_irq_disable_all() and alt_irq_enable_all(), as they would from 
+ * non-interrupt code.
+ */
+
+extern void alt_irq_priority_set (alt_u32 id, alt_u32 priority);
+
+#endif /* ALT_IRQ_NESTING */
 #endif 
 
 #ifdef __cplusplus
@@ -0,0 +1,95 @@
+#ifndef __ALT_IRQ_PROFILE_H__
+#define __ALT_IRQ_PROFILE_H__
+
+/******************************************************************************
+*                                                                             *
+* License Agreement                                                           *
+*                                                                             *
+* Copyright (c) 2004 Altera Corporation, San Jose, California, USA.           *
+* All rights reserved.                                                        *
+*                                                                             *
+* Permission is hereby granted, free of charge, to any person obtaining a     *
+* copy of this software and associated documentation files (the "Software"),  *
+* to deal in the Software without restriction, including without limitation   *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,    *
+* and/or sell copies of the Software, and to permit persons to whom the       *
+* Software is furnished to do so, subject to the following conditions:        *
+*                                                                             *
+* The above copyright notice and this permission notice shall be included in  *
+* all copies or substantial portions of the Software.                         *
+*                                                                             *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR  *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,    *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER      *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING     *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER         *
+* DEALINGS IN THE SOFTWARE.                                                   *
+*                                                                             *
+* This agreement shall be governed in all respects by the laws of the State   *
+* of California and by the laws of the United States of America.              *
+*                                                                             *
+* Altera does not recommend, suggest or require that this reference design    *
+* file be used in conjunction or combination with any other product.          *
+******************************************************************************/
+
+/*
+ * alt_irq_profile.h provides optional instrumentation of alt_irq_handler().
+ * When ALT_IRQ_PROFILE is defined, the handler timestamps the entry to and
+ * exit from each registered interrupt handler, and records:
+ *
+ * - the number of times the handler has run,
+ * - a log2 histogram of its execution time,
+ * - a log2 histogram of the time between successive interrupts,
+ * - the longest execution time and shortest inter-arrival time seen,
+ * - the longest and total dispatch time, i.e. the time alt_irq_handler()
+ *   spent finding the interrupt before calling its handler.
+ *
+ * Times are measured in counts of the timestamp timer, see alt_timestamp.h,
+ * which must have been started by the application. Bucket "n" of a histogram
+ * counts times in the range [2^(n-1), 2^n), with bucket zero counting times
+ * of zero.
+ *
+ * When ALT_IRQ_PROFILE is not defined, none of this is compiled and the
+ * interrupt handler is unchanged.
+ */
+
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+#ifdef ALT_IRQ_PROFILE
+
+#define ALT_IRQ_PROFILE_BUCKETS 33
+
+typedef struct alt_irq_profile_s
+{
+  alt_u32 count;                              /* handler invocations */
+  alt_u32 last_entry;                         /* timestamp of the last entry */
+  alt_u32 exec_max;                           /* longest execution time */
+  alt_u32 interval_min;                       /* shortest inter-arrival time */
+  alt_u32 dispatch_max;                       /* longest dispatch time */
+  alt_u32 dispatch_total;                     /* sum of dispatch times */
+  alt_u32 exec[ALT_IRQ_PROFILE_BUCKETS];      /* execution time histogram */
+  alt_u32 interval[ALT_IRQ_PROFILE_BUCKETS];  /* inter-arrival histogram */
+} alt_irq_profile_t;
+
+extern alt_irq_profile_t alt_irq_profile[ALT_NIRQ];
+
+/*
+ * alt_irq_profile_clear() discards everything recorded so far.
+ */
+
+extern void alt_irq_profile_clear (void);
+
+#endif /* ALT_IRQ_PROFILE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ALT_IRQ_PROFILE_H__ */
@@ -49,6 +49,15 @@ extern "C"
 
 extern int alt_timestamp_start (void);
 
+/*
+ * alt_timestamp_start_continuous() starts the timestamp counter in free 
+ * running mode. Rather than stopping at full period, the count wraps, so the
+ * difference between two alt_timestamp() values is correct for any interval
+ * shorter than one full period of the counter.
+ */
+
+extern int alt_timestamp_start_continuous (void);
+
 extern alt_timestamp_type alt_timestamp (void);
 
 extern alt_u32 alt_timestamp_freq (void);
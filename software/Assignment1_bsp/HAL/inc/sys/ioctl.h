@@ -79,6 +79,13 @@ extern int ioctl (int fd, int req, void* arg);
 #define TIOCSTIMEOUT 0x6a01 /* Set Timeout before assuming no host present */
 #define TIOCGCONNECTED 0x6a02 /* Get indication of whether host is connected */
 
+/*
+ * ioctl calls specific to the Avalon UART.
+ */
+
+#define TIOCGUARTSTATS 0x7501 /* Get the error and buffer usage counters */
+#define TIOCCUARTSTATS 0x7502 /* Reset them */
+
 /*
  *
  */
@@ -36,37 +36,16 @@
 #include "sys/alt_irq.h"
 
 /*
- * alt_alarm_start is called to register an alarm with the system. The 
- * "alarm" structure passed as an input argument does not need to be 
- * initialised by the user. This is done within this function.
- *
- * The remaining input arguments are:
- *
- * nticks - The time to elapse until the alarm executes. This is specified in
- *          system clock ticks.
- * callback - The function to run when the indicated time has elapsed.
- * context  - An opaque value, passed to the callback function. 
-*
- * Care should be taken when defining the callback function since it is 
- * likely to execute in interrupt context. In particular, this mean that 
- * library calls like printf() should not be made, since they can result in 
- * deadlock.
- *
- * The interval to be used for the next callback is the return
- * value from the callback function. A return value of zero indicates that the
- * alarm should be unregistered. 
- * 
- * alt_alarm_start() will fail if  the timer facility has not been enabled 
- * (i.e. there is no system clock). Failure is indicated by a negative return 
- * value.
- */ 
+ * alt_alarm_schedule() does the work for alt_alarm_start() and 
+ * alt_alarm_start_at(). The alarm is due at "time", plus the current tick 
+ * count when "relative" is non-zero.
+ */
 
-int alt_alarm_start (alt_alarm* alarm, alt_u32 nticks,
-                     alt_u32 (*callback) (void* context),
-                     void* context)
+static int alt_alarm_schedule (alt_alarm* alarm, alt_u32 time, int relative,
+                               alt_u32 (*callback) (void* context),
+                               void* context)
 {
   alt_irq_context irq_context;
-  alt_u32 current_nticks = 0;
   
   if (alt_ticks_per_second ())
   {
@@ -77,25 +56,28 @@ int alt_alarm_start (alt_alarm* alarm, alt_u32 nticks,
  
       irq_context = alt_irq_disable_all ();
       
-      current_nticks = alt_nticks();
-      
-      alarm->time = nticks + current_nticks + 1; 
+      if (relative)
+      {
+        time += alt_nticks() + 1;
+      }
+
+      alarm->time = time; 
       
       /* 
-       * If the desired alarm time causes a roll-over, set the rollover
-       * flag. This will prevent the subsequent tick event from causing
-       * an alarm too early.
+       * The wheel files alarms relative to the current tick, so an alarm 
+       * time which rolls over the 32 bit tick counter needs no special
+       * treatment. An absolute time which has already passed is due on the 
+       * next tick.
        */
-      if(alarm->time < current_nticks)
-      {
-        alarm->rollover = 1;
-      }
-      else
-      {
-        alarm->rollover = 0;
-      }
     
-      alt_llist_insert (&alt_alarm_list, &alarm->llist);
+      alt_alarm_wheel_insert (alarm);
+
+#ifdef ALT_SYS_CLK_TICKLESS
+      /* the new alarm may be due before the timer is next set to expire */
+
+      alt_sysclk_resync ();
+#endif
+
       alt_irq_enable_all (irq_context);
 
       return 0;
@@ -110,3 +92,51 @@ int alt_alarm_start (alt_alarm* alarm, alt_u32 nticks,
     return -ENOTSUP;
   }
 }
+
+/*
+ * alt_alarm_start is called to register an alarm with the system. The 
+ * "alarm" structure passed as an input argument does not need to be 
+ * initialised by the user. This is done within this function.
+ *
+ * The remaining input arguments are:
+ *
+ * nticks - The time to elapse until the alarm executes. This is specified in
+ *          system clock ticks.
+ * callback - The function to run when the indicated time has elapsed.
+ * context  - An opaque value, passed to the callback function. 
+*
+ * Care should be taken when defining the callback function since it is 
+ * likely to execute in interrupt context. In particular, this mean that 
+ * library calls like printf() should not be made, since they can result in 
+ * deadlock.
+ *
+ * The interval to be used for the next callback is the return
+ * value from the callback function. A return value of zero indicates that the
+ * alarm should be unregistered. 
+ * 
+ * alt_alarm_start() will fail if  the timer facility has not been enabled 
+ * (i.e. there is no system clock). Failure is indicated by a negative return 
+ * value.
+ */ 
+
+int alt_alarm_start (alt_alarm* alarm, alt_u32 nticks,
+                     alt_u32 (*callback) (void* context),
+                     void* context)
+{
+  return alt_alarm_schedule (alarm, nticks, 1, callback, context);
+}
+
+/*
+ * alt_alarm_start_at() is equivalent to alt_alarm_start(), except that the
+ * alarm is due when the tick count, as returned by alt_nticks(), reaches 
+ * "time". Since the callback return value is added to the time the alarm was 
+ * due rather than to the time it ran, a periodic alarm started this way stays
+ * locked to the absolute schedule, whatever the interrupt latency.
+ */
+
+int alt_alarm_start_at (alt_alarm* alarm, alt_u32 time,
+                        alt_u32 (*callback) (void* context),
+                        void* context)
+{
+  return alt_alarm_schedule (alarm, time, 0, callback, context);
+}
@@ -97,7 +97,14 @@ alt_u32 alt_ic_irq_enabled(alt_u32 ic_id, alt_u32 irq)
 {
     alt_u32 irq_enabled;
 
+#ifdef ALT_IRQ_NESTING
+    /* ienable is narrowed while a handler runs, so use the full list */
+    extern volatile alt_u32 alt_irq_active;
+
+    irq_enabled = alt_irq_active;
+#else
     NIOS2_READ_IENABLE(irq_enabled);
+#endif
 
     return (irq_enabled & (1 << irq)) ? 1: 0;
 }
@@ -45,12 +45,159 @@
 
 #include "alt_types.h"
 
+#if !defined(ALT_CI_INTERRUPT_VECTOR) || defined(ALT_IRQ_PROFILE)
+
+/*
+ * Lookup table used by alt_irq_handler() to convert an isolated interrupt bit
+ * into its interrupt number, see below, and by alt_irq_profile_bucket() to
+ * find the top bit of a time. It is aligned to a data cache line so
+ * that it occupies exactly one.
+ */
+
+#define ALT_IRQ_DEBRUIJN 0x077CB531u
+
+static const alt_u8 alt_irq_debruijn[32] 
+  __attribute__ ((aligned (32))) =
+{
+  0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+  31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
+
+#endif
+
+#ifdef ALT_IRQ_PROFILE
+
+#include <string.h>
+
+#include "sys/alt_irq_profile.h"
+#include "sys/alt_timestamp.h"
+#include "altera_avalon_timer_regs.h"
+
+#if (ALT_TIMESTAMP_COUNTER_SIZE == 64)
+#error ALT_IRQ_PROFILE requires a 32 bit timestamp timer
+#endif
+
+/*
+ * "alt_irq_profile" holds the per interrupt statistics gathered by
+ * alt_irq_handler(), see sys/alt_irq_profile.h.
+ */
+
+alt_irq_profile_t alt_irq_profile[ALT_NIRQ];
+
+void alt_irq_profile_clear (void)
+{
+  alt_irq_context context = alt_irq_disable_all ();
+
+  memset (alt_irq_profile, 0, sizeof (alt_irq_profile));
+
+  alt_irq_enable_all (context);
+}
+
+/*
+ * alt_irq_profile_stamp() is equivalent to alt_timestamp(), but is inlined
+ * into the interrupt handler. Interrupts are already disabled here, so the
+ * snapshot can be read without the protection alt_timestamp() needs. This
+ * keeps the cost of each measurement down to a single write and two reads of
+ * the timer.
+ */
+
+static ALT_INLINE alt_u32 ALT_ALWAYS_INLINE alt_irq_profile_stamp (void)
+{
+  void* base = altera_avalon_timer_ts_base;
+
+  IOWR_ALTERA_AVALON_TIMER_SNAPL (base, 0);
+  return ~(((IORD_ALTERA_AVALON_TIMER_SNAPH (base) & 
+             ALTERA_AVALON_TIMER_SNAPH_MSK) << 16) |
+           (IORD_ALTERA_AVALON_TIMER_SNAPL (base) & 
+             ALTERA_AVALON_TIMER_SNAPL_MSK));
+}
+
+/*
+ * alt_irq_profile_bucket() returns the histogram bucket for a time, one more
+ * than the position of its top set bit, or 0 for no time. Nios II has no 
+ * count leading zeros instruction, and __builtin_clz() would be a libgcc 
+ * call, so the bits below the top one are set, the top one is isolated, and 
+ * it is looked up in the de Bruijn table used for dispatch.
+ */
+
+static ALT_INLINE alt_u32 ALT_ALWAYS_INLINE alt_irq_profile_bucket (alt_u32 t)
+{
+  t |= t >> 1;
+  t |= t >> 2;
+  t |= t >> 4;
+  t |= t >> 8;
+  t |= t >> 16;
+
+  return t ? alt_irq_debruijn[((t ^ (t >> 1)) * ALT_IRQ_DEBRUIJN) >> 27] + 1 : 0;
+}
+
+/*
+ * alt_irq_profile_record() updates the statistics for interrupt "id", given
+ * the timestamps taken either side of the call to its handler. "start" is the
+ * timestamp taken on entry to alt_irq_handler(), or at the end of the previous
+ * handler if several are run in one pass, so that "entry - start" is the
+ * dispatch overhead.
+ */
+
+static ALT_INLINE void ALT_ALWAYS_INLINE alt_irq_profile_record (alt_u32 id,
+                                   alt_u32 start, alt_u32 entry, alt_u32 exit)
+{
+  alt_irq_profile_t* profile  = &alt_irq_profile[id];
+  alt_u32            exec     = exit - entry;
+  alt_u32            dispatch = entry - start;
+  alt_u32            interval;
+
+  profile->dispatch_total += dispatch;
+  if (dispatch > profile->dispatch_max)
+  {
+    profile->dispatch_max = dispatch;
+  }
+
+  profile->exec[alt_irq_profile_bucket (exec)]++;
+  if (exec > profile->exec_max)
+  {
+    profile->exec_max = exec;
+  }
+
+  if (profile->count++)
+  {
+    interval = entry - profile->last_entry;
+    profile->interval[alt_irq_profile_bucket (interval)]++;
+    if ((profile->count == 2) || (interval < profile->interval_min))
+    {
+      profile->interval_min = interval;
+    }
+  }
+  profile->last_entry = entry;
+}
+
+#define ALT_IRQ_PROFILE_START(start) start = alt_irq_profile_stamp ()
+#define ALT_IRQ_PROFILE_ENTER(entry) entry = alt_irq_profile_stamp ()
+#define ALT_IRQ_PROFILE_EXIT(id, start, entry)                  \
+  do {                                                          \
+    alt_u32 exit = alt_irq_profile_stamp ();                    \
+    alt_irq_profile_record (id, start, entry, exit);            \
+    start = exit;                                               \
+  } while (0)
+
+#else /* ALT_IRQ_PROFILE */
+
+#define ALT_IRQ_PROFILE_START(start)
+#define ALT_IRQ_PROFILE_ENTER(entry)
+#define ALT_IRQ_PROFILE_EXIT(id, start, entry)
+
+#endif /* ALT_IRQ_PROFILE */
+
 /*
  * A table describing each interrupt handler. The index into the array is the
  * interrupt id associated with the handler. 
  *
  * When an interrupt occurs, the associated handler is called with
  * the argument stored in the context member.
+ *
+ * Each entry is eight bytes, and the table is aligned to a data cache line, 
+ * so the entries for the low numbered (highest priority) interrupts share 
+ * the first line.
  */
 struct ALT_IRQ_HANDLER
 {
@@ -60,7 +207,82 @@ struct ALT_IRQ_HANDLER
   void (*handler)(void*, alt_u32);
 #endif
   void *context;
-} alt_irq[ALT_NIRQ];
+} alt_irq[ALT_NIRQ] __attribute__ ((aligned (32)));
+
+#ifndef ALT_CI_INTERRUPT_VECTOR
+
+#ifdef ALT_IRQ_NESTING
+
+#ifdef ALT_EXCEPTION_STACK
+#error ALT_IRQ_NESTING can not be used with a separate exception stack
+#endif
+
+#if (ALT_NIRQ != 32)
+#error ALT_IRQ_NESTING assumes 32 interrupts
+#endif
+
+/*
+ * "alt_irq_priority" holds the priority of each interrupt, as set by 
+ * alt_irq_priority_set(), and "alt_irq_preempt" holds, for each interrupt, 
+ * the list of interrupts which may preempt its handler. Both start in the 
+ * hardware order, where a lower interrupt number has higher priority.
+ */
+
+extern volatile alt_u32 alt_irq_active;
+extern volatile alt_u32 alt_priority_mask;
+
+#define ALT_IRQ_SEQ4(f, n) f(n), f(n + 1), f(n + 2), f(n + 3)
+#define ALT_IRQ_SEQ32(f)                                               \
+  ALT_IRQ_SEQ4(f, 0),  ALT_IRQ_SEQ4(f, 4),  ALT_IRQ_SEQ4(f, 8),        \
+  ALT_IRQ_SEQ4(f, 12), ALT_IRQ_SEQ4(f, 16), ALT_IRQ_SEQ4(f, 20),       \
+  ALT_IRQ_SEQ4(f, 24), ALT_IRQ_SEQ4(f, 28)
+
+#define ALT_IRQ_PRIORITY_DEFAULT(n) (n)
+#define ALT_IRQ_PREEMPT_DEFAULT(n)  ((1u << (n)) - 1)
+
+static alt_u8 alt_irq_priority[ALT_NIRQ] = 
+{
+  ALT_IRQ_SEQ32 (ALT_IRQ_PRIORITY_DEFAULT)
+};
+
+static alt_u32 alt_irq_preempt[ALT_NIRQ] = 
+{
+  ALT_IRQ_SEQ32 (ALT_IRQ_PREEMPT_DEFAULT)
+};
+
+void alt_irq_priority_set (alt_u32 id, alt_u32 priority)
+{
+  alt_irq_context context;
+  alt_u32         i;
+  alt_u32         j;
+
+  if (id >= ALT_NIRQ)
+  {
+    return;
+  }
+
+  context = alt_irq_disable_all ();
+
+  alt_irq_priority[id] = priority;
+
+  for (i = 0; i < ALT_NIRQ; i++)
+  {
+    alt_irq_preempt[i] = 0;
+    for (j = 0; j < ALT_NIRQ; j++)
+    {
+      if (alt_irq_priority[j] < alt_irq_priority[i])
+      {
+        alt_irq_preempt[i] |= (1u << j);
+      }
+    }
+  }
+
+  alt_irq_enable_all (context);
+}
+
+#endif /* ALT_IRQ_NESTING */
+
+#endif /* ALT_CI_INTERRUPT_VECTOR */
 
 /*
  * alt_irq_handler() is called by the interrupt exception handler in order to 
@@ -84,9 +306,15 @@ void alt_irq_handler (void)
   char*  alt_irq_base = (char*)alt_irq;
 #else
   alt_u32 active;
-  alt_u32 mask;
   alt_u32 i;
+#ifdef ALT_IRQ_NESTING
+  alt_u32 mask;
+#endif
 #endif /* ALT_CI_INTERRUPT_VECTOR */
+#ifdef ALT_IRQ_PROFILE
+  alt_u32 start;
+  alt_u32 entry;
+#endif
   
   /*
    * Notify the operating system that we are at interrupt level.
@@ -94,6 +322,8 @@ void alt_irq_handler (void)
   
   ALT_OS_INT_ENTER();
 
+  ALT_IRQ_PROFILE_START (start);
+
 #ifdef ALT_CI_INTERRUPT_VECTOR
   /*
    * Call the interrupt vector custom instruction using the 
@@ -105,11 +335,13 @@ void alt_irq_handler (void)
   while ((offset = ALT_CI_INTERRUPT_VECTOR) >= 0) {
     struct ALT_IRQ_HANDLER* handler_entry = 
       (struct ALT_IRQ_HANDLER*)(alt_irq_base + offset);
+    ALT_IRQ_PROFILE_ENTER (entry);
 #ifdef ALT_ENHANCED_INTERRUPT_API_PRESENT
     handler_entry->handler(handler_entry->context);
 #else
     handler_entry->handler(handler_entry->context, offset >> 3);
 #endif
+    ALT_IRQ_PROFILE_EXIT (offset >> 3, start, entry);
   }
 #else /* ALT_CI_INTERRUPT_VECTOR */
   /* 
@@ -129,30 +361,71 @@ void alt_irq_handler (void)
 
   do
   {
-    i = 0;
-    mask = 1;
-
     /*
-     * Test each bit in turn looking for an active interrupt. Once one is 
-     * found, the interrupt handler asigned by a call to alt_irq_register() is
+     * Find the lowest numbered active interrupt in constant time. Nios II has
+     * no count trailing zeros instruction, so the lowest set bit is isolated 
+     * and multiplied by a de Bruijn sequence, which leaves a unique value in 
+     * the top five bits for each bit position. This costs a handful of 
+     * instructions, whereas testing each bit in turn costs four per bit 
+     * position below the active interrupt.
+     *
+     * The interrupt handler asigned by a call to alt_irq_register() is then
      * called to clear the interrupt condition.
      */
 
-    do
+    i = alt_irq_debruijn[((active & -active) * ALT_IRQ_DEBRUIJN) >> 27];
+
+#ifdef ALT_IRQ_NESTING
+    /* 
+     * With configurable priorities, the lowest numbered interrupt may not be
+     * the most urgent. Narrow the search to the interrupts which would be 
+     * allowed to preempt it, until there are none pending.
+     */
+
+    while (active & alt_irq_preempt[i])
     {
-      if (active & mask)
-      { 
+      active &= alt_irq_preempt[i];
+      i = alt_irq_debruijn[((active & -active) * ALT_IRQ_DEBRUIJN) >> 27];
+    }
+#endif
+
+    ALT_IRQ_PROFILE_ENTER (entry);
+
+#ifdef ALT_IRQ_NESTING
+    /*
+     * Mask this interrupt and every interrupt of equal or lower priority, 
+     * then let the handler run with interrupts enabled. The exception entry
+     * code has already saved ea and estatus on the stack, so a nested 
+     * exception is safe. The previous mask is put back afterwards, since this
+     * may itself be a nested call.
+     */
+
+    mask              = alt_priority_mask;
+    alt_priority_mask = mask & alt_irq_preempt[i];
+    NIOS2_WRITE_IENABLE (alt_irq_active & alt_priority_mask);
+    NIOS2_WRITE_STATUS (NIOS2_STATUS_PIE_MSK);
+#endif
+
 #ifdef ALT_ENHANCED_INTERRUPT_API_PRESENT
-        alt_irq[i].handler(alt_irq[i].context); 
+    alt_irq[i].handler(alt_irq[i].context); 
 #else
-        alt_irq[i].handler(alt_irq[i].context, i); 
+    alt_irq[i].handler(alt_irq[i].context, i); 
+#endif
+
+#ifdef ALT_IRQ_NESTING
+    NIOS2_WRITE_STATUS (0);
+    alt_priority_mask = mask;
+    NIOS2_WRITE_IENABLE (alt_irq_active & mask);
 #endif
-        break;
-      }
-      mask <<= 1;
-      i++;
 
-    } while (1);
+    ALT_IRQ_PROFILE_EXIT (i, start, entry);
+
+    /*
+     * The pending list is read again rather than working through the rest 
+     * of the old one, so that an interrupt of higher priority which arrived 
+     * during the handler is serviced next. Reading it is a single control 
+     * register access.
+     */
 
     active = alt_irq_pending ();
     
@@ -51,11 +51,102 @@ alt_u32 _alt_tick_rate = 0;
 volatile alt_u32 _alt_nticks = 0;
 
 /*
- * "alt_alarm_list" is the head of a linked list of registered alarms. This is
- * initialised to be an empty list.
+ * "alt_alarm_wheel" holds the registered alarms, see priv/alt_alarm.h. The
+ * list heads are initialised on first use by alt_alarm_wheel_init().
  */
 
-ALT_LLIST_HEAD(alt_alarm_list);
+static alt_llist alt_alarm_wheel[ALT_ALARM_WHEEL_LEVELS][ALT_ALARM_WHEEL_SLOTS];
+
+/*
+ * "alt_alarm_wheel_time" is the next system clock tick to be processed by 
+ * the wheel. Alarms are filed relative to this value.
+ */
+
+static alt_u32 alt_alarm_wheel_time;
+static alt_u8  alt_alarm_wheel_ready = 0;
+
+/*
+ * alt_alarm_wheel_init() sets every slot of the wheel to be an empty list.
+ */
+
+static void alt_alarm_wheel_init (void)
+{
+  alt_u32 level;
+  alt_u32 slot;
+
+  for (level = 0; level < ALT_ALARM_WHEEL_LEVELS; level++)
+  {
+    for (slot = 0; slot < ALT_ALARM_WHEEL_SLOTS; slot++)
+    {
+      alt_alarm_wheel[level][slot].next     = &alt_alarm_wheel[level][slot];
+      alt_alarm_wheel[level][slot].previous = &alt_alarm_wheel[level][slot];
+    }
+  }
+
+  alt_alarm_wheel_time  = _alt_nticks + 1;
+  alt_alarm_wheel_ready = 1;
+}
+
+/*
+ * alt_alarm_wheel_insert() files an alarm in the slot which will next be
+ * processed (or cascaded) at, or before, the alarm's expiry time. Alarms which
+ * are already due are filed in the slot for the next tick.
+ */
+
+void alt_alarm_wheel_insert (alt_alarm* alarm)
+{
+  alt_u32 delta;
+  alt_u32 level = 0;
+  alt_u32 slot;
+
+  if (!alt_alarm_wheel_ready)
+  {
+    alt_alarm_wheel_init ();
+  }
+
+  delta = alarm->time - alt_alarm_wheel_time;
+
+  if ((alt_32) delta < 0)
+  {
+    slot = alt_alarm_wheel_time & ALT_ALARM_WHEEL_MASK;
+  }
+  else
+  {
+    while ((level < (ALT_ALARM_WHEEL_LEVELS - 1)) &&
+           (delta >> ((level + 1) * ALT_ALARM_WHEEL_BITS)))
+    {
+      level++;
+    }
+    slot = (alarm->time >> (level * ALT_ALARM_WHEEL_BITS)) & 
+             ALT_ALARM_WHEEL_MASK;
+  }
+
+  alt_llist_insert (&alt_alarm_wheel[level][slot], &alarm->llist);
+}
+
+/*
+ * alt_alarm_wheel_cascade() re-files every alarm in the given slot. Since the
+ * wheel has advanced into the span of that slot, each alarm moves down to a
+ * lower level. The return value is the slot index, so that the caller knows
+ * whether this level has also wrapped.
+ */
+
+static alt_u32 alt_alarm_wheel_cascade (alt_u32 level)
+{
+  alt_u32    slot  = (alt_alarm_wheel_time >> (level * ALT_ALARM_WHEEL_BITS)) &
+                       ALT_ALARM_WHEEL_MASK;
+  alt_llist* head  = &alt_alarm_wheel[level][slot];
+  alt_alarm* alarm;
+
+  while (head->next != head)
+  {
+    alarm = (alt_alarm*) head->next;
+    alt_llist_remove (&alarm->llist);
+    alt_alarm_wheel_insert (alarm);
+  }
+
+  return slot;
+}
 
 /*
  * alt_alarm_stop() is called to remove an alarm from the list of registered 
@@ -72,72 +163,220 @@ void alt_alarm_stop (alt_alarm* alarm)
   alt_irq_enable_all (irq_context);
 }
 
+/*
+ * alt_alarm_wheel_next() returns the number of ticks after 
+ * "alt_alarm_wheel_time" at which the wheel next has work to do, i.e. either
+ * a level zero slot holds an alarm, or a non-empty slot on a higher level is
+ * due to be cascaded. If "exact" is set, the expiry time of the earliest
+ * alarm in a non-empty higher level slot is returned instead of the time that
+ * slot cascades. The search stops at "limit", which is returned if there is 
+ * nothing to do before then.
+ */
+
+static alt_u32 alt_alarm_wheel_next (alt_u32 limit, int exact)
+{
+  alt_u32    level;
+  alt_u32    slot;
+  alt_u32    span;
+  alt_u32    delta;
+  alt_u32    i;
+  alt_llist* entry;
+
+  for (i = 0; (i < ALT_ALARM_WHEEL_SLOTS) && (i < limit); i++)
+  {
+    slot = (alt_alarm_wheel_time + i) & ALT_ALARM_WHEEL_MASK;
+    if (alt_alarm_wheel[0][slot].next != &alt_alarm_wheel[0][slot])
+    {
+      limit = i;
+      break;
+    }
+  }
+
+  for (level = 1; level < ALT_ALARM_WHEEL_LEVELS; level++)
+  {
+    span  = 1UL << (level * ALT_ALARM_WHEEL_BITS);
+    delta = (0 - alt_alarm_wheel_time) & (span - 1);
+    slot  = ((alt_alarm_wheel_time + delta) >> (level * ALT_ALARM_WHEEL_BITS)) &
+              ALT_ALARM_WHEEL_MASK;
+
+    for (i = 0; (i < ALT_ALARM_WHEEL_SLOTS) && (delta < limit); i++)
+    {
+      if (alt_alarm_wheel[level][slot].next != &alt_alarm_wheel[level][slot])
+      {
+        if (!exact)
+        {
+          limit = delta;
+        }
+        else
+        {
+          for (entry  = alt_alarm_wheel[level][slot].next;
+               entry != &alt_alarm_wheel[level][slot];
+               entry  = entry->next)
+          {
+            delta = ((alt_alarm*) entry)->time - alt_alarm_wheel_time;
+            if (delta < limit)
+            {
+              limit = delta;
+            }
+          }
+        }
+        break;
+      }
+      if (span > (limit - delta))
+      {
+        break;
+      }
+      delta += span;
+      slot   = (slot + 1) & ALT_ALARM_WHEEL_MASK;
+    }
+  }
+
+  return limit;
+}
+
+/*
+ * alt_alarm_next_tick() is used by a tickless system clock driver to decide
+ * when it next needs to interrupt. It returns the number of ticks, counted 
+ * from the current value of _alt_nticks, until alt_tick_advance() must next 
+ * be called. The result is in the range 1 to "limit".
+ */
+
+alt_u32 alt_alarm_next_tick (alt_u32 limit)
+{
+  if (!alt_alarm_wheel_ready)
+  {
+    alt_alarm_wheel_init ();
+  }
+
+  if (limit <= 1)
+  {
+    return 1;
+  }
+
+  return alt_alarm_wheel_next (limit - 1, 1) + 1;
+}
+
 /*
  * alt_tick() is periodically called by the system clock driver in order to
- * process the registered list of alarms. Each alarm is registed with a
- * callback interval, and a callback function, "callback". 
+ * process the registered alarms. Each alarm is registed with a callback 
+ * interval, and a callback function, "callback". 
  *
  * The return value of the callback function indicates how many ticks are to
  * elapse until the next callback. A return value of zero indicates that the
  * alarm should be deactivated. 
+ *
+ * Only the wheel slot for the current tick is visited, so the cost of a tick
+ * depends on the number of alarms which expire, rather than the number which
+ * are registered.
  * 
  * alt_tick() is expected to run at interrupt level.
  */
 
 void alt_tick (void)
 {
-  alt_alarm* next;
-  alt_alarm* alarm = (alt_alarm*) alt_alarm_list.next;
+  alt_tick_advance (1);
+}
 
+/*
+ * alt_tick_advance() is the equivalent of calling alt_tick() "nticks" times.
+ * It is used by tickless system clock drivers, which only interrupt when an
+ * alarm is due. Runs of ticks with nothing to process are skipped in a single
+ * step.
+ */
+
+void alt_tick_advance (alt_u32 nticks)
+{
+  ALT_LLIST_HEAD(expired);
+  alt_alarm* alarm;
+  alt_u32    slot;
+  alt_u32    level;
   alt_u32    next_callback;
 
   /* update the tick counter */
 
-  _alt_nticks++;
+  _alt_nticks += nticks;
+
+  if (!alt_alarm_wheel_ready)
+  {
+    alt_alarm_wheel_init ();
+  }
 
   /* process the registered callbacks */
 
-  while (alarm != (alt_alarm*) &alt_alarm_list)
+  while ((alt_32) (_alt_nticks - alt_alarm_wheel_time) >= 0)
   {
-    next = (alt_alarm*) alarm->llist.next;
+    if (_alt_nticks != alt_alarm_wheel_time)
+    {
+      alt_alarm_wheel_time += 
+        alt_alarm_wheel_next (_alt_nticks - alt_alarm_wheel_time, 0);
+    }
+
+    slot = alt_alarm_wheel_time & ALT_ALARM_WHEEL_MASK;
 
     /* 
-     * Upon the tick-counter rolling over it is safe to clear the 
-     * roll-over flag; once the flag is cleared this (or subsequnt)
-     * tick events are enabled to generate an alarm event. 
+     * When the lowest level wraps, pull the next slot of each higher level 
+     * down, stopping at the first level which has not itself wrapped.
      */
-    if ((alarm->rollover) && (_alt_nticks == 0))
+
+    if (!slot)
     {
-      alarm->rollover = 0;
+      for (level = 1; level < ALT_ALARM_WHEEL_LEVELS; level++)
+      {
+        if (alt_alarm_wheel_cascade (level))
+        {
+          break;
+        }
+      }
     }
-    
-    /* if the alarm period has expired, make the callback */    
-    if ((alarm->time <= _alt_nticks) && (alarm->rollover == 0))
+
+    /* 
+     * Move the expiring alarms onto a private list, so that callbacks are 
+     * free to stop any alarm, including their own, and to start any alarm 
+     * that is not registered. A callback restarts its own alarm by stopping
+     * it and starting it again.
+     */
+
+    if (alt_alarm_wheel[0][slot].next != &alt_alarm_wheel[0][slot])
     {
+      expired.next           = alt_alarm_wheel[0][slot].next;
+      expired.previous       = alt_alarm_wheel[0][slot].previous;
+      expired.next->previous = &expired;
+      expired.previous->next = &expired;
+
+      alt_alarm_wheel[0][slot].next     = &alt_alarm_wheel[0][slot];
+      alt_alarm_wheel[0][slot].previous = &alt_alarm_wheel[0][slot];
+    }
+
+    alt_alarm_wheel_time++;
+
+    while (expired.next != &expired)
+    {
+      alarm = (alt_alarm*) expired.next;
+
       next_callback = alarm->callback (alarm->context);
 
-      /* deactivate the alarm if the return value is zero */
+      /* 
+       * The callback may have stopped, or stopped and restarted, this alarm,
+       * in which case it is no longer at the head of the expired list. It is
+       * left as the callback left it: a stopped alarm stays unregistered, a
+       * restarted one keeps its new time, and the return value is ignored.
+       */
 
-      if (next_callback == 0)
+      if (expired.next != &alarm->llist)
       {
-        alt_alarm_stop (alarm);
+        continue;
       }
-      else
+
+      alt_llist_remove (&alarm->llist);
+
+      /* deactivate the alarm if the return value is zero */
+
+      if (next_callback != 0)
       {
         alarm->time += next_callback;
-        
-        /* 
-         * If the desired alarm time causes a roll-over, set the rollover
-         * flag. This will prevent the subsequent tick event from causing
-         * an alarm too early.
-         */
-        if(alarm->time < _alt_nticks)
-        {
-          alarm->rollover = 1;
-        }
+        alt_alarm_wheel_insert (alarm);
       }
     }
-    alarm = next;
   }
 
   /* 
@@ -146,4 +385,3 @@ void alt_tick (void)
 
   ALT_OS_TIME_TICK();
 }
-
@@ -54,6 +54,18 @@ extern "C"
 #define ALT_LCD_WIDTH         16
 #define ALT_LCD_VIRTUAL_WIDTH 80
 
+/*
+ * When ALT_LCD_16207_ASYNC is defined, commands for the panel are not written
+ * by polling the busy flag. Instead they are placed in a queue, which an 
+ * alarm drains at one command per system clock tick, so writes to the device
+ * return immediately. ALT_LCD_QUEUE_SIZE must be a power of two, and large 
+ * enough to hold a repaint of the whole panel.
+ */
+
+#define ALT_LCD_QUEUE_SIZE    64
+#define ALT_LCD_QUEUE_DATA    0x100 /* queue entry is data, not a command */
+#define ALT_LCD_BUSY_SLOTS    100   /* busy slots before giving up on panel */
+
 typedef struct altera_avalon_lcd_16207_state_s 
 {
   int            base;
@@ -76,6 +88,18 @@ typedef struct altera_avalon_lcd_16207_state_s
 
   char           escape[8];
 
+#ifdef ALT_LCD_16207_ASYNC
+  alt_alarm      feed_alarm;
+  char           async;     /* If non-zero, commands are queued rather than
+                             * written directly. Cleared during init. */
+  char           feeding;   /* feed_alarm is running */
+  char           repaint;   /* a repaint was cut short by a full queue */
+  unsigned char  busy_slots;/* consecutive slots the panel was busy */
+  volatile unsigned char head;
+  volatile unsigned char tail;
+  unsigned short queue[ALT_LCD_QUEUE_SIZE];
+#endif
+
   struct
   {
     char         visible[ALT_LCD_WIDTH];
@@ -94,6 +118,13 @@ typedef struct altera_avalon_lcd_16207_state_s
  */
 extern void altera_avalon_lcd_16207_init(altera_avalon_lcd_16207_state* sp);
 
+/*
+ * Returns the number of commands waiting to be sent to the panel. This is 
+ * always zero unless ALT_LCD_16207_ASYNC is defined. The same value is 
+ * available through ioctl(fd, TIOCOUTQ, &count).
+ */
+extern int altera_avalon_lcd_16207_pending(altera_avalon_lcd_16207_state* sp);
+
 /* 
  * The LCD panel driver is not trivial, so leave it out in the small
  * drivers case.  Also leave it out in simulation because there is no
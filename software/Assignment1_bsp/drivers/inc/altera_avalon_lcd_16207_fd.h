@@ -43,6 +43,7 @@ extern "C"
  */
 extern int altera_avalon_lcd_16207_write_fd(alt_fd* fd, const char* ptr,
   int len);
+extern int altera_avalon_lcd_16207_ioctl_fd(alt_fd* fd, int req, void* arg);
 
 /*
  * Device structure definition. This is needed by alt_sys_init in order to 
@@ -79,7 +80,7 @@ typedef struct altera_avalon_lcd_16207_dev_s
         altera_avalon_lcd_16207_write_fd,                \
         NULL, /* lseek */                                \
         NULL, /* fstat */                                \
-        NULL, /* ioctl */                                \
+        altera_avalon_lcd_16207_ioctl_fd,                \
       },                                                 \
       {                                                  \
         name##_BASE                                      \
@@ -72,6 +72,14 @@ extern "C"
 extern void alt_avalon_timer_sc_init (void* base, alt_u32 irq_controller_id, 
                                       alt_u32 irq, alt_u32 freq);
 
+/*
+ * "alt_avalon_timer_sc_irq_count" is the number of system clock interrupts
+ * taken since reset. Comparing this against alt_nticks() shows how many
+ * interrupts the tickless mode (ALT_SYS_CLK_TICKLESS) has saved.
+ */
+
+extern volatile alt_u32 alt_avalon_timer_sc_irq_count;
+
 /*
  * Variables used to store the timestamp parameters, when the device is to be
  * accessed using the high resolution timestamp driver.
@@ -103,18 +103,37 @@ typedef struct altera_avalon_uart_state_s
 #define ALT_UART_WRITE_RDY 0x2
 
 /*
- * ALT_AVALON_UART_BUF_LEN is the length of the circular buffers used to hold
- * pending transmit and receive data. This value must be a power of two.
+ * The circular buffers used to hold pending transmit and receive data are
+ * sized separately for each instance, by <name>_TX_BUF_LEN and 
+ * <name>_RX_BUF_LEN, e.g. UART_TX_BUF_LEN for the device named UART in 
+ * system.h. These are set in the BSP settings (hal.make.bsp_cflags_user_flags
+ * in settings.bsp), and must be defined for every UART using the fast 
+ * driver. Both must be powers of two, which is checked at build time. The 
+ * buffers are allocated alongside the device instance, and the driver finds
+ * them through rx_buf, tx_buf and their masks.
  */
 
-#define ALT_AVALON_UART_BUF_LEN (64)
-
 /*
- * ALT_AVALON_UART_BUF_MSK is used as an internal convenience for detecting 
- * the end of the arrays used to implement the transmit and receive buffers.
+ * When ALT_UART_LINES is defined the receive interrupt handler frames the
+ * incoming data into lines, rather than queueing it character by character.
+ * The receive buffer is divided into slots of ALT_AVALON_UART_LINE_LEN 
+ * bytes, so <name>_RX_BUF_LEN must be at least twice that. Each line is 
+ * assembled in a slot, and is made available to altera_avalon_uart_getline()
+ * once its '\r' or '\n' arrives. Lines longer than ALT_AVALON_UART_LINE_LEN,
+ * and lines that arrive while every slot is full, are discarded and counted
+ * in rx_dropped.
+ *
+ * A zero byte starts a binary record, which runs up to the next zero byte
+ * and may contain '\r' and '\n'. It is returned with its leading zero, so
+ * that it can be told apart from a line, but without the closing one. This
+ * carries zero delimited (e.g. COBS encoded) frames on the same port.
  */
 
-#define ALT_AVALON_UART_BUF_MSK (ALT_AVALON_UART_BUF_LEN - 1)
+#ifdef ALT_UART_LINES
+#define ALT_AVALON_UART_LINE_LEN (64)
+#define ALT_AVALON_UART_LINE(sp, slot) \
+  (&(sp)->rx_buf[(slot) * ALT_AVALON_UART_LINE_LEN])
+#endif
 
 /*
  * This is somewhat of an ugly hack, but we need some mechanism for
@@ -141,6 +160,28 @@ typedef struct altera_avalon_uart_state_s
 
 #define ALT_AVALON_UART_FC 0x2
 
+/*
+ * The altera_avalon_uart_stats structure holds the error and buffer usage
+ * counters kept by the interrupt handler and write(). They are read with 
+ * ioctl(fd, TIOCGUARTSTATS, &stats), which also fills in the usable size of
+ * each buffer, and reset with ioctl(fd, TIOCCUARTSTATS, NULL). Both require
+ * ALTERA_AVALON_UART_USE_IOCTL.
+ */
+
+typedef struct altera_avalon_uart_stats_s
+{
+  alt_u32 rx_overruns; /* Characters lost in the device before being read */
+  alt_u32 rx_framing;  /* Characters discarded with a framing error */
+  alt_u32 rx_parity;   /* Characters discarded with a parity error */
+  alt_u32 rx_dropped;  /* With ALT_UART_LINES, lines discarded by the driver */
+  alt_u32 tx_full;     /* Times a write found the transmit buffer full */
+  alt_u32 rx_high;     /* Most receive buffer entries in use, characters or,
+                        * with ALT_UART_LINES, complete lines */
+  alt_u32 tx_high;     /* Most transmit buffer characters in use */
+  alt_u32 rx_size;     /* Receive buffer entries, filled in by the ioctl */
+  alt_u32 tx_size;     /* Transmit buffer characters, filled in by the ioctl */
+} altera_avalon_uart_stats;
+
 /*
  * The altera_avalon_uart_state structure is used to hold device specific data.
  * This includes the transmit and receive buffers.
@@ -158,6 +199,14 @@ typedef struct altera_avalon_uart_state_s
   volatile alt_u32 rx_end;          /* End of the pending receive data */
   volatile alt_u32 tx_start;        /* Start of the pending transmit data */
   volatile alt_u32 tx_end;          /* End of the pending transmit data */
+  volatile alt_u8* rx_buf;          /* The receive buffer */
+#ifdef ALT_UART_LINES
+  alt_u8*          line_len;        /* Length of the line in each slot */
+#endif
+  alt_u32          rx_msk;          /* Receive buffer length less one, or with
+                                     * ALT_UART_LINES the slots less one */
+  volatile alt_u8* tx_buf;          /* The transmit buffer */
+  alt_u32          tx_msk;          /* Transmit buffer length less one */
 #ifdef ALTERA_AVALON_UART_USE_IOCTL
   struct termios termios;           /* Current device configuration */
   alt_u32          freq;            /* Current baud rate */
@@ -170,10 +219,49 @@ typedef struct altera_avalon_uart_state_s
                                      * read buffer in multi-threaded mode */
   ALT_SEM          (write_lock)     /* Semaphore used to control access to the
                                      * write buffer in multi-threaded mode */
-  volatile alt_u8  rx_buf[ALT_AVALON_UART_BUF_LEN]; /* The receive buffer */
-  volatile alt_u8  tx_buf[ALT_AVALON_UART_BUF_LEN]; /* The transmit buffer */
+#ifdef ALT_UART_LINES
+  alt_u32          line_fill;       /* Length of the line being assembled */
+  alt_u32          line_binary;     /* It is a zero delimited record */
+#endif
+  altera_avalon_uart_stats stats;   /* Error and buffer usage counters */
 } altera_avalon_uart_state;
 
+/*
+ * The macros below allocate the buffers for an instance, named after its 
+ * state, and initialise the buffer fields of the state to match:
+ *
+ * ALTERA_AVALON_UART_BUFFERS   - Define the buffers.
+ * ALTERA_AVALON_UART_RX_BUFFER - Initialise rx_buf, line_len and rx_msk.
+ * ALTERA_AVALON_UART_TX_BUFFER - Initialise tx_buf and tx_msk.
+ */
+
+#ifdef ALT_UART_LINES
+
+#define ALTERA_AVALON_UART_BUFFERS(name, state)                 \
+  static volatile alt_u8 state##_rx_buf[name##_RX_BUF_LEN];    \
+  static alt_u8 state##_line_len[name##_RX_BUF_LEN /            \
+                                 ALT_AVALON_UART_LINE_LEN];     \
+  static volatile alt_u8 state##_tx_buf[name##_TX_BUF_LEN];
+#define ALTERA_AVALON_UART_RX_BUFFER(name, state)               \
+  state##_rx_buf,                                               \
+  state##_line_len,                                             \
+  (name##_RX_BUF_LEN / ALT_AVALON_UART_LINE_LEN) - 1,
+
+#else /* !ALT_UART_LINES */
+
+#define ALTERA_AVALON_UART_BUFFERS(name, state)                 \
+  static volatile alt_u8 state##_rx_buf[name##_RX_BUF_LEN];    \
+  static volatile alt_u8 state##_tx_buf[name##_TX_BUF_LEN];
+#define ALTERA_AVALON_UART_RX_BUFFER(name, state)               \
+  state##_rx_buf,                                               \
+  name##_RX_BUF_LEN - 1,
+
+#endif /* ALT_UART_LINES */
+
+#define ALTERA_AVALON_UART_TX_BUFFER(name, state)               \
+  state##_tx_buf,                                               \
+  name##_TX_BUF_LEN - 1,
+
 /*
  * Conditionally define the data structures used to process ioctl requests.
  * The following macros are defined for use in creating a device instance:
@@ -228,6 +316,7 @@ typedef struct altera_avalon_uart_state_s
  */
 
 #define ALTERA_AVALON_UART_STATE_INSTANCE(name, state) \
+  ALTERA_AVALON_UART_BUFFERS(name, state)              \
   altera_avalon_uart_state state =                     \
    {                                                   \
      (void*) name##_BASE,                              \
@@ -236,6 +325,8 @@ typedef struct altera_avalon_uart_state_s
      0,                                                \
      0,                                                \
      0,                                                \
+     ALTERA_AVALON_UART_RX_BUFFER(name, state)         \
+     ALTERA_AVALON_UART_TX_BUFFER(name, state)         \
      ALTERA_AVALON_UART_TERMIOS(name##_STOP_BITS,      \
                                (name##_PARITY == 'N'), \
                                (name##_PARITY == 'O'), \
@@ -259,15 +350,40 @@ typedef struct altera_avalon_uart_state_s
 extern void altera_avalon_uart_init(altera_avalon_uart_state* sp,
                                     alt_u32 irq_controller_id, alt_u32 irq);
 
+/*
+ * altera_avalon_uart_getline() copies the next complete received line or 
+ * binary record into "ptr", without its terminator, and returns its length. It is only 
+ * available when ALT_UART_LINES is defined, in which case read() on the 
+ * device also returns one line per call.
+ */
+
+#ifdef ALT_UART_LINES
+extern int altera_avalon_uart_getline(altera_avalon_uart_state* sp, 
+                                      char* ptr, int len, int flags);
+#endif
+
 /*
  * The macro ALTERA_AVALON_UART_STATE_INIT is used by the auto-generated file
  * alt_sys_init.c to initialize an instance of the device driver state.
  *
  * This macro performs a sanity check to ensure that the interrupt has been
- * connected for this device. If not, then an apropriate error message is 
- * generated at build time.
+ * connected for this device, and that its buffer sizes are usable. If not, 
+ * then an apropriate error message is generated at build time.
  */
 
+#define ALTERA_AVALON_UART_POW2(len) ((len) && !((len) & ((len) - 1)))
+
+#ifdef ALT_UART_LINES
+#define ALTERA_AVALON_UART_BUF_OK(name)                 \
+  (ALTERA_AVALON_UART_POW2(name##_RX_BUF_LEN) &&        \
+   ALTERA_AVALON_UART_POW2(name##_TX_BUF_LEN) &&        \
+   (name##_RX_BUF_LEN >= 2 * ALT_AVALON_UART_LINE_LEN))
+#else
+#define ALTERA_AVALON_UART_BUF_OK(name)                 \
+  (ALTERA_AVALON_UART_POW2(name##_RX_BUF_LEN) &&        \
+   ALTERA_AVALON_UART_POW2(name##_TX_BUF_LEN))
+#endif
+
 #define ALTERA_AVALON_UART_STATE_INIT(name, state)                         \
   if (name##_IRQ == ALT_IRQ_NOT_CONNECTED)                                 \
   {                                                                        \
@@ -280,6 +396,12 @@ extern void altera_avalon_uart_init(altera_avalon_uart_state* sp,
                     "using the -DALTERA_AVALON_UART_SMALL preprocessor "   \
                     "flag.");                                              \
   }                                                                        \
+  else if (!ALTERA_AVALON_UART_BUF_OK(name))                               \
+  {                                                                        \
+    ALT_LINK_ERROR ("Error: " #name "_RX_BUF_LEN and " #name "_TX_BUF_LEN " \
+                    "must be powers of two, and with ALT_UART_LINES the "  \
+                    "receive buffer must hold at least two lines.");       \
+  }                                                                        \
   else                                                                     \
   {                                                                        \
     altera_avalon_uart_init(&state, name##_IRQ_INTERRUPT_CONTROLLER_ID,    \
@@ -94,6 +94,7 @@ extern int altera_avalon_uart_close_fd(alt_fd* fd);
 #endif
 
 #define ALTERA_AVALON_UART_DEV_INSTANCE(name, d)       \
+  ALTERA_AVALON_UART_BUFFERS(name, d)                  \
   static altera_avalon_uart_dev d =                    \
    {                                                   \
      {                                                 \
@@ -114,6 +115,8 @@ extern int altera_avalon_uart_close_fd(alt_fd* fd);
        0,                                              \
        0,                                              \
        0,                                              \
+       ALTERA_AVALON_UART_RX_BUFFER(name, d)           \
+       ALTERA_AVALON_UART_TX_BUFFER(name, d)           \
        ALTERA_AVALON_UART_TERMIOS(name##_STOP_BITS,    \
                                (name##_PARITY == 'N'), \
                                (name##_PARITY == 'O'), \
@@ -57,6 +57,15 @@
  *    ESC [ K                 Clear from current position to end of line
  *    ESC [ 2 J               Clear screen and go to top left
  *
+ * When ALT_LCD_16207_ASYNC is defined, the commands generated by a write are
+ * queued, and sent to the panel one per system clock tick by an alarm, see
+ * alt_lcd_16207_feed(). The write returns as soon as the commands are queued.
+ * Since only cells which differ from what is on the panel generate commands,
+ * a full queue is not an error: the repaint stops, and is restarted when the
+ * queue has drained.
+ *
+ * ESC [ 2 J only blanks the text, so rewriting a screen after clearing it 
+ * sends just the cells which changed, see lcd_clear_screen().
  */
 
 /* ===================================================================== */
@@ -69,6 +78,7 @@
 #include <errno.h>
 
 #include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
 
 #include "altera_avalon_lcd_16207_regs.h"
 #include "altera_avalon_lcd_16207.h"
@@ -134,6 +144,47 @@ static char colstart[4] = { 0x00, 0x40, 0x20, 0x60 };
 
 /* --------------------------------------------------------------------- */
 
+#ifdef ALT_LCD_16207_ASYNC
+
+static alt_u32 alt_lcd_16207_feed(void* context);
+
+/*
+ * Number of free entries in the command queue.
+ */
+static int lcd_queue_space(altera_avalon_lcd_16207_state* sp)
+{
+  return ALT_LCD_QUEUE_SIZE - (unsigned char)(sp->head - sp->tail);
+}
+
+/*
+ * Add an entry to the command queue.  The caller checks for space first.
+ */
+static void lcd_queue(altera_avalon_lcd_16207_state* sp, unsigned short entry)
+{
+  sp->queue[sp->head & (ALT_LCD_QUEUE_SIZE - 1)] = entry;
+  sp->head++;
+}
+
+/*
+ * Start the alarm which drains the queue, unless it is already running.
+ */
+static void lcd_feed_start(altera_avalon_lcd_16207_state* sp)
+{
+  alt_irq_context context = alt_irq_disable_all();
+
+  if (!sp->feeding && sp->head != sp->tail)
+  {
+    sp->feeding = 1;
+    alt_alarm_start(&sp->feed_alarm, 1, &alt_lcd_16207_feed, sp);
+  }
+
+  alt_irq_enable_all(context);
+}
+
+#endif /* ALT_LCD_16207_ASYNC */
+
+/* --------------------------------------------------------------------- */
+
 static void lcd_write_command(altera_avalon_lcd_16207_state* sp, 
   unsigned char command)
 {
@@ -150,6 +201,14 @@ static void lcd_write_command(altera_avalon_lcd_16207_state* sp,
   if (sp->broken)
     return;
 
+#ifdef ALT_LCD_16207_ASYNC
+  if (sp->async)
+  {
+    lcd_queue(sp, command);
+    return;
+  }
+#endif
+
   /* Wait until LCD isn't busy. */
   while (IORD_ALTERA_AVALON_LCD_16207_STATUS(base) & ALTERA_AVALON_LCD_16207_STATUS_BUSY_MSK)
     if (--i == 0)
@@ -184,6 +243,15 @@ static void lcd_write_data(altera_avalon_lcd_16207_state* sp,
   if (sp->broken)
     return;
 
+#ifdef ALT_LCD_16207_ASYNC
+  if (sp->async)
+  {
+    lcd_queue(sp, ALT_LCD_QUEUE_DATA | data);
+    sp->address++;
+    return;
+  }
+#endif
+
   /* Wait until LCD isn't busy. */
   while (IORD_ALTERA_AVALON_LCD_16207_STATUS(base) & ALTERA_AVALON_LCD_16207_STATUS_BUSY_MSK)
     if (--i == 0)
@@ -204,26 +272,47 @@ static void lcd_write_data(altera_avalon_lcd_16207_state* sp,
 
 /* --------------------------------------------------------------------- */
 
+/*
+ * The visible[] array of each line is a shadow of what is on the panel, and
+ * lcd_repaint_screen() only sends the cells which differ from it.  Clearing
+ * the screen therefore just blanks the text; the panel itself is only sent
+ * the clear command at init, by lcd_clear_panel().  Rewriting a screen with
+ * mostly the same text then costs a few commands rather than a clear (1.64ms)
+ * followed by a write to every cell.
+ */
+
 static void lcd_clear_screen(altera_avalon_lcd_16207_state* sp)
 {
   int y;
 
-  lcd_write_command(sp, LCD_CMD_CLEAR);
-
   sp->x = 0;
   sp->y = 0;
-  sp->address = 0;
 
   for (y = 0 ; y < ALT_LCD_HEIGHT ; y++)
   {
     memset(sp->line[y].data, ' ', sizeof(sp->line[0].data));
-    memset(sp->line[y].visible, ' ', sizeof(sp->line[0].visible));
     sp->line[y].width = 0;
   }
 }
 
 /* --------------------------------------------------------------------- */
 
+static void lcd_clear_panel(altera_avalon_lcd_16207_state* sp)
+{
+  int y;
+
+  lcd_write_command(sp, LCD_CMD_CLEAR);
+
+  sp->address = 0;
+
+  for (y = 0 ; y < ALT_LCD_HEIGHT ; y++)
+    memset(sp->line[y].visible, ' ', sizeof(sp->line[0].visible));
+
+  lcd_clear_screen(sp);
+}
+
+/* --------------------------------------------------------------------- */
+
 static void lcd_repaint_screen(altera_avalon_lcd_16207_state* sp)
 {
   int y, x;
@@ -251,6 +340,20 @@ static void lcd_repaint_screen(altera_avalon_lcd_16207_state* sp)
       {
         unsigned char address = x + colstart[y];
 
+#ifdef ALT_LCD_16207_ASYNC
+        /* Each cell needs at most an address and a data entry.  If they 
+         * won't fit, the rest of the repaint is left until the queue has 
+         * drained.  The cells not yet queued still differ from visible[],
+         * so they will be picked up then.
+         */
+        if (sp->async && lcd_queue_space(sp) < 2)
+        {
+          sp->repaint = 1;
+          lcd_feed_start(sp);
+          return;
+        }
+#endif
+
         if (address != sp->address)
         {
           lcd_write_command(sp, LCD_CMD_WRITE_DATA | address);
@@ -262,6 +365,11 @@ static void lcd_repaint_screen(altera_avalon_lcd_16207_state* sp)
       }
     }
   }
+
+#ifdef ALT_LCD_16207_ASYNC
+  if (sp->async)
+    lcd_feed_start(sp);
+#endif
 }
 
 /* --------------------------------------------------------------------- */
@@ -385,7 +493,7 @@ int altera_avalon_lcd_16207_write(altera_avalon_lcd_16207_state* sp,
 
         sp->esccount = -1;
       }
-      else if (sp->esccount < sizeof(sp->escape)-1)
+      else if (esccount < sizeof(sp->escape)-1)
       {
         sp->escape[esccount] = c;
         sp->esccount++;
@@ -547,6 +655,81 @@ static alt_u32 alt_lcd_16207_timeout(void* context)
 
 /* --------------------------------------------------------------------- */
 
+#ifdef ALT_LCD_16207_ASYNC
+
+/*
+ * Feed routine is called every tick while there are commands queued.  It
+ * sends at most one command to the panel.  The panel takes at most 1.64ms to 
+ * carry out a command, so if it is still busy the slot is skipped rather 
+ * than waited for.
+ */
+
+static alt_u32 alt_lcd_16207_feed(void* context) 
+{
+  altera_avalon_lcd_16207_state* sp = (altera_avalon_lcd_16207_state*)context;
+  unsigned int base = sp->base;
+  unsigned short entry;
+
+  if (sp->head == sp->tail)
+  {
+    /* Finish a repaint which didn't fit in the queue */
+    if (sp->repaint && !sp->active)
+    {
+      sp->repaint = 0;
+      lcd_repaint_screen(sp);
+    }
+
+    if (sp->head == sp->tail)
+    {
+      sp->feeding = 0;
+      return 0;
+    }
+  }
+
+  if (IORD_ALTERA_AVALON_LCD_16207_STATUS(base) & ALTERA_AVALON_LCD_16207_STATUS_BUSY_MSK)
+  {
+    /* Give up if the panel stays busy, as the polled driver does */
+    if (++sp->busy_slots >= ALT_LCD_BUSY_SLOTS)
+    {
+      sp->broken  = 1;
+      sp->tail    = sp->head;
+      sp->feeding = 0;
+      return 0;
+    }
+    return 1;
+  }
+
+  sp->busy_slots = 0;
+
+  entry = sp->queue[sp->tail & (ALT_LCD_QUEUE_SIZE - 1)];
+  sp->tail++;
+
+  if (entry & ALT_LCD_QUEUE_DATA)
+    IOWR_ALTERA_AVALON_LCD_16207_DATA(base, entry & 0xFF);
+  else
+    IOWR_ALTERA_AVALON_LCD_16207_COMMAND(base, entry);
+
+  return 1;
+}
+
+#endif /* ALT_LCD_16207_ASYNC */
+
+/* --------------------------------------------------------------------- */
+
+/*
+ * Returns the number of commands which have not yet been sent to the panel
+ */
+int altera_avalon_lcd_16207_pending(altera_avalon_lcd_16207_state* sp)
+{
+#ifdef ALT_LCD_16207_ASYNC
+  return (unsigned char)(sp->head - sp->tail) + sp->repaint;
+#else
+  return 0;
+#endif
+}
+
+/* --------------------------------------------------------------------- */
+
 /*
  * Called at boot time to initialise the LCD driver
  */
@@ -557,6 +740,16 @@ void altera_avalon_lcd_16207_init(altera_avalon_lcd_16207_state* sp)
   /* Mark the device as functional */
   sp->broken = 0;
 
+#ifdef ALT_LCD_16207_ASYNC
+  /* The panel is set up by polling; queueing starts once it is ready */
+  sp->async = 0;
+  sp->feeding = 0;
+  sp->repaint = 0;
+  sp->busy_slots = 0;
+  sp->head = 0;
+  sp->tail = 0;
+#endif
+
   ALT_SEM_CREATE (&sp->write_lock, 1);
 
   /* The initialisation sequence below is copied from the datasheet for
@@ -584,7 +777,7 @@ void altera_avalon_lcd_16207_init(altera_avalon_lcd_16207_state* sp)
   lcd_write_command(sp, LCD_CMD_ONOFF);
 
   /* Clear display */
-  lcd_clear_screen(sp);
+  lcd_clear_panel(sp);
   
   /* Set mode: increment after writing, don't shift display */
   lcd_write_command(sp, LCD_CMD_MODES | LCD_CMD_MODE_INC);
@@ -601,5 +794,9 @@ void altera_avalon_lcd_16207_init(altera_avalon_lcd_16207_state* sp)
 
   sp->period = alt_ticks_per_second() / 10; /* Call every 100ms */
 
+#ifdef ALT_LCD_16207_ASYNC
+  sp->async = 1;
+#endif
+
   alt_alarm_start(&sp->alarm, sp->period, &alt_lcd_16207_timeout, sp);
 }
@@ -28,8 +28,11 @@
 *                                                                             *
 ******************************************************************************/
 
+#include <errno.h>
+
 #include "alt_types.h"
 #include "sys/alt_dev.h"
+#include "sys/ioctl.h"
 #include "altera_avalon_lcd_16207.h"
 
 extern int altera_avalon_lcd_16207_write(altera_avalon_lcd_16207_state* sp,
@@ -43,3 +46,24 @@ altera_avalon_lcd_16207_write_fd(alt_fd* fd, const char* buffer, int space)
     return altera_avalon_lcd_16207_write(&dev->state, buffer, space,
       fd->fd_flags);
 }
+
+/*
+ * The only ioctl supported is TIOCOUTQ, which returns the number of commands
+ * still waiting to be sent to the panel. Zero indicates that the panel shows
+ * everything written so far.
+ */
+
+int 
+altera_avalon_lcd_16207_ioctl_fd(alt_fd* fd, int req, void* arg)
+{
+    altera_avalon_lcd_16207_dev* dev = (altera_avalon_lcd_16207_dev*) fd->dev; 
+
+    if (req != TIOCOUTQ)
+    {
+      return -ENOTTY;
+    }
+
+    *(int*) arg = altera_avalon_lcd_16207_pending(&dev->state);
+
+    return 0;
+}
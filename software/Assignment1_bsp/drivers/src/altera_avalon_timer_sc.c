@@ -41,6 +41,213 @@
 #include "alt_types.h"
 #include "sys/alt_log_printf.h"
 
+/*
+ * "alt_avalon_timer_sc_irq_count" counts the system clock interrupts taken
+ * since reset. 
+ */
+
+volatile alt_u32 alt_avalon_timer_sc_irq_count = 0;
+
+#ifdef ALT_SYS_CLK_TICKLESS
+
+/*
+ * In tickless mode the timer is not left running with a fixed period of one
+ * tick. Instead, each time it expires it is reprogrammed to expire when the
+ * next alarm is due, see alt_alarm_next_tick(). The counter is run in 
+ * continuous mode, so that the time taken to service the interrupt can be 
+ * measured and carried forward. The tick count therefore only drifts by the
+ * few cycles taken to reload the counter.
+ *
+ * The state below describes the period currently loaded into the timer:
+ *
+ * cycles - timer clock cycles per system clock tick.
+ * max    - the longest period, in ticks, which fits in the 32 bit counter.
+ * period - the value loaded into the period registers.
+ * armed  - the number of ticks which will have elapsed when the counter 
+ *          next reaches zero.
+ * phase  - the number of timer clock cycles between the last tick accounted
+ *          for in _alt_nticks, and the point where the counter was loaded.
+ * busy   - set while the interrupt handler is processing alarms.
+ */
+
+#define ALT_AVALON_TIMER_SC_MIN_CYCLES 256
+
+static void*   alt_avalon_timer_sc_base;
+static alt_u32 alt_avalon_timer_sc_cycles;
+static alt_u32 alt_avalon_timer_sc_max;
+static alt_u32 alt_avalon_timer_sc_period;
+static alt_u32 alt_avalon_timer_sc_armed;
+static alt_u32 alt_avalon_timer_sc_phase;
+static alt_u8  alt_avalon_timer_sc_busy;
+
+/*
+ * alt_avalon_timer_sc_count() returns the number of timer clock cycles since
+ * the counter was last loaded with the period.
+ */
+
+static alt_u32 alt_avalon_timer_sc_count (void* base)
+{
+  alt_u32 lower;
+  alt_u32 upper;
+
+  IOWR_ALTERA_AVALON_TIMER_SNAPL (base, 0);
+  lower = IORD_ALTERA_AVALON_TIMER_SNAPL (base) & ALTERA_AVALON_TIMER_SNAPL_MSK;
+  upper = IORD_ALTERA_AVALON_TIMER_SNAPH (base) & ALTERA_AVALON_TIMER_SNAPH_MSK;
+
+  return alt_avalon_timer_sc_period - ((upper << 16) | lower);
+}
+
+/*
+ * alt_avalon_timer_sc_arm() loads the counter so that it will expire after
+ * "ticks" system clock ticks, measured from the last accounted tick.
+ */
+
+static void alt_avalon_timer_sc_arm (void* base, alt_u32 ticks)
+{
+  alt_u32 period;
+
+  if (ticks > alt_avalon_timer_sc_max)
+  {
+    ticks = alt_avalon_timer_sc_max;
+  }
+
+  period = ticks * alt_avalon_timer_sc_cycles - alt_avalon_timer_sc_phase;
+
+  /* don't program a period too short to leave the interrupt handler */
+
+  if (period < ALT_AVALON_TIMER_SC_MIN_CYCLES)
+  {
+    ticks++;
+    period += alt_avalon_timer_sc_cycles;
+  }
+
+  alt_avalon_timer_sc_period = period - 1;
+  alt_avalon_timer_sc_armed  = ticks;
+
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (base, ALTERA_AVALON_TIMER_CONTROL_STOP_MSK);
+  IOWR_ALTERA_AVALON_TIMER_PERIODL (base, (period - 1) & 0xFFFF);
+  IOWR_ALTERA_AVALON_TIMER_PERIODH (base, (period - 1) >> 16);
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (base, 
+            ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+}
+
+/*
+ * alt_avalon_timer_sc_catch_up() processes any ticks which have elapsed since
+ * the counter was loaded, and then reloads it for the next alarm. Since alarm
+ * callbacks can take longer than a tick, the counter is re-read until no
+ * further ticks have elapsed.
+ *
+ * The phase is moved past the elapsed ticks before they are passed to 
+ * alt_tick_advance(), so that a callback calling alt_nticks() does not count
+ * them twice. Until the counter is reloaded it may then lie before the load
+ * point, which the unsigned arithmetic allows for.
+ */
+
+static void alt_avalon_timer_sc_catch_up (void* base)
+{
+  alt_u32 cycles;
+  alt_u32 ticks;
+
+  do
+  {
+    cycles = alt_avalon_timer_sc_phase + alt_avalon_timer_sc_count (base);
+    ticks  = cycles / alt_avalon_timer_sc_cycles;
+
+    if (!ticks)
+    {
+      break;
+    }
+
+    alt_avalon_timer_sc_phase -= ticks * alt_avalon_timer_sc_cycles;
+    alt_tick_advance (ticks);
+  } while (1);
+
+  alt_avalon_timer_sc_phase = cycles;
+
+  alt_avalon_timer_sc_arm (base, alt_alarm_next_tick (alt_avalon_timer_sc_max));
+}
+
+/*
+ * alt_sysclk_nticks() returns the tick count, including the ticks which have
+ * elapsed since the timer was last loaded.
+ */
+
+alt_u32 alt_sysclk_nticks (void)
+{
+  alt_irq_context cpu_sr;
+  alt_u32         ticks;
+  void*           base = alt_avalon_timer_sc_base;
+
+  if (!base)
+  {
+    return _alt_nticks;
+  }
+
+  cpu_sr = alt_irq_disable_all();
+
+  if (IORD_ALTERA_AVALON_TIMER_STATUS (base) & ALTERA_AVALON_TIMER_STATUS_TO_MSK)
+  {
+    ticks = alt_avalon_timer_sc_armed;
+  }
+  else
+  {
+    ticks = (alt_avalon_timer_sc_phase + alt_avalon_timer_sc_count (base)) /
+              alt_avalon_timer_sc_cycles;
+  }
+
+  ticks += _alt_nticks;
+
+  alt_irq_enable_all(cpu_sr);
+
+  return ticks;
+}
+
+/*
+ * alt_sysclk_resync() is called by alt_alarm_start(), with interrupts 
+ * disabled, after a new alarm has been registered. The elapsed time is 
+ * folded into the tick count and the timer is reloaded, in case the new alarm
+ * is due before the current period expires. If the current period has 
+ * already expired, or the alarm was started from an alarm callback, the
+ * interrupt handler is left to do this.
+ */
+
+void alt_sysclk_resync (void)
+{
+  void* base = alt_avalon_timer_sc_base;
+
+  if (!base || alt_avalon_timer_sc_busy)
+  {
+    return;
+  }
+
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (base, ALTERA_AVALON_TIMER_CONTROL_STOP_MSK);
+
+  if (IORD_ALTERA_AVALON_TIMER_STATUS (base) & ALTERA_AVALON_TIMER_STATUS_TO_MSK)
+  {
+    IOWR_ALTERA_AVALON_TIMER_CONTROL (base, 
+            ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+  }
+  else
+  {
+    /* 
+     * The catch up runs alarm callbacks, which may start alarms and so call 
+     * back in here. Mark it busy, as the interrupt handler does, so that the
+     * same elapsed ticks are not counted twice. The reload at the end of the
+     * catch up takes any alarm started by a callback into account.
+     */
+
+    alt_avalon_timer_sc_busy = 1;
+    alt_avalon_timer_sc_catch_up (base);
+    alt_avalon_timer_sc_busy = 0;
+  }
+}
+
+#endif /* ALT_SYS_CLK_TICKLESS */
+
 /* 
  * alt_avalon_timer_sc_irq() is the interrupt handler used for the system 
  * clock. This is called periodically when a timer interrupt occurs. The 
@@ -49,6 +256,9 @@
  *
  * alt_tick() increments the system tick count, and updates any registered 
  * alarms, see alt_tick.c for further details.
+ *
+ * In tickless mode the counter was loaded to expire when the next alarm is 
+ * due, so all of the ticks in that period are passed to alt_tick_advance().
  */
 #ifdef ALT_ENHANCED_INTERRUPT_API_PRESENT
 static void alt_avalon_timer_sc_irq (void* base)
@@ -58,6 +268,16 @@ static void alt_avalon_timer_sc_irq (void* base, alt_u32 id)
 {
   alt_irq_context cpu_sr;
   
+#ifdef ALT_SYS_CLK_TICKLESS
+  /* 
+   * Until the expired period has been added to _alt_nticks, the TO bit is 
+   * what tells alt_sysclk_nticks() and alt_sysclk_resync() that it has 
+   * expired. Disable interrupts before clearing it, so that a higher 
+   * priority interrupt cannot see the tick count a whole period behind.
+   */
+  cpu_sr = alt_irq_disable_all();
+#endif
+
   /* clear the interrupt */
   IOWR_ALTERA_AVALON_TIMER_STATUS (base, 0);
   
@@ -68,6 +288,8 @@ static void alt_avalon_timer_sc_irq (void* base, alt_u32 id)
    */
   IORD_ALTERA_AVALON_TIMER_CONTROL (base);
 
+  alt_avalon_timer_sc_irq_count++;
+
   /* ALT_LOG - see altera_hal/HAL/inc/sys/alt_log_printf.h */
   ALT_LOG_SYS_CLK_HEARTBEAT();
 
@@ -75,8 +297,17 @@ static void alt_avalon_timer_sc_irq (void* base, alt_u32 id)
    * Notify the system of a clock tick. disable interrupts 
    * during this time to safely support ISR preemption
    */
+#ifdef ALT_SYS_CLK_TICKLESS
+  /* the counter has reloaded, exactly "armed" ticks after it was loaded */
+  alt_avalon_timer_sc_busy  = 1;
+  alt_avalon_timer_sc_phase = 0;
+  alt_tick_advance (alt_avalon_timer_sc_armed);
+  alt_avalon_timer_sc_catch_up (base);
+  alt_avalon_timer_sc_busy  = 0;
+#else
   cpu_sr = alt_irq_disable_all();
   alt_tick ();
+#endif
   alt_irq_enable_all(cpu_sr);
 }
 
@@ -84,6 +315,9 @@ static void alt_avalon_timer_sc_irq (void* base, alt_u32 id)
  * alt_avalon_timer_sc_init() is called to initialise the timer that will be 
  * used to provide the periodic system clock. This is called from the 
  * auto-generated alt_sys_init() function.
+ *
+ * In tickless mode the length of a tick is taken from the period registers,
+ * which hold the period configured in SOPC builder following reset.
  */
 
 void alt_avalon_timer_sc_init (void* base, alt_u32 irq_controller_id, 
@@ -93,12 +327,27 @@ void alt_avalon_timer_sc_init (void* base, alt_u32 irq_controller_id,
   
   alt_sysclk_init (freq);
   
+#ifdef ALT_SYS_CLK_TICKLESS
+  alt_avalon_timer_sc_cycles = 
+    (((IORD_ALTERA_AVALON_TIMER_PERIODH (base) & ALTERA_AVALON_TIMER_PERIODH_MSK)
+        << 16) |
+     (IORD_ALTERA_AVALON_TIMER_PERIODL (base) & ALTERA_AVALON_TIMER_PERIODL_MSK))
+    + 1;
+  alt_avalon_timer_sc_max   = 0xFFFFFFFF / alt_avalon_timer_sc_cycles;
+  alt_avalon_timer_sc_phase = 0;
+  alt_avalon_timer_sc_base  = base;
+
+  /* expire when the first alarm is due */
+
+  alt_avalon_timer_sc_arm (base, alt_alarm_next_tick (alt_avalon_timer_sc_max));
+#else
   /* set to free running mode */
   
   IOWR_ALTERA_AVALON_TIMER_CONTROL (base, 
             ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
             ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
             ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+#endif
 
   /* register the interrupt handler, and enable the interrupt */
 #ifdef ALT_ENHANCED_INTERRUPT_API_PRESENT
@@ -34,6 +34,7 @@
 
 #include "system.h"
 #include "sys/alt_timestamp.h"
+#include "sys/alt_irq.h"
 
 #include "altera_avalon_timer.h"
 #include "altera_avalon_timer_regs.h"
@@ -88,6 +89,29 @@ int alt_timestamp_start(void)
   return 0;
 }
 
+/*
+ * alt_timestamp_start_continuous() is the same as alt_timestamp_start(), 
+ * except that the timer is run in continuous mode. The count wraps back to 
+ * zero after reaching full scale, so unsigned differences between timestamps
+ * remain valid for intervals of up to one full period.
+ */
+
+int alt_timestamp_start_continuous(void)
+{
+  void* base = altera_avalon_timer_ts_base;
+
+  if (alt_timestamp_start())
+  {
+    return -1;
+  }
+
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (base, 
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+
+  return 0;
+}
+
 /*
  * alt_timestamp() returns the current timestamp count. In the event that
  * the timer has run full period, or there is no timestamp available, this
@@ -121,9 +145,16 @@ alt_timestamp_type alt_timestamp(void)
         
         return (0xFFFFFFFFFFFFFFFFULL - ( (snap_3 << 48) | (snap_2 << 32) | (snap_1 << 16) | (snap_0) ));
 #else
+        /*
+         * The snapshot is taken and read with interrupts disabled, since an
+         * interrupt handler taking its own snapshot between the two reads
+         * would otherwise tear the result.
+         */
+        alt_irq_context context = alt_irq_disable_all ();
         IOWR_ALTERA_AVALON_TIMER_SNAPL (base, 0);
         alt_timestamp_type lower = IORD_ALTERA_AVALON_TIMER_SNAPL(base) & ALTERA_AVALON_TIMER_SNAPL_MSK;
         alt_timestamp_type upper = IORD_ALTERA_AVALON_TIMER_SNAPH(base) & ALTERA_AVALON_TIMER_SNAPH_MSK;
+        alt_irq_enable_all (context);
         
         return (0xFFFFFFFF - ((upper << 16) | lower)); 
 #endif
@@ -124,6 +124,12 @@ static void altera_avalon_uart_irq(void* context, alt_u32 id)
   /* Clear any error flags set at the device */
   IOWR_ALTERA_AVALON_UART_STATUS(base, 0);
 
+  /* A character arrived before the last one was read, and was lost */
+  if (status & ALTERA_AVALON_UART_STATUS_ROE_MSK)
+  {
+    sp->stats.rx_overruns++;
+  }
+
   /* Dummy read to ensure IRQ is negated before ISR returns */
   IORD_ALTERA_AVALON_UART_STATUS(base);
   
@@ -143,6 +149,137 @@ static void altera_avalon_uart_irq(void* context, alt_u32 id)
 
 }
 
+/*
+ * altera_avalon_uart_rxerr() counts a received character that is being 
+ * discarded because of a parity or framing error.
+ */
+static void 
+altera_avalon_uart_rxerr(altera_avalon_uart_state* sp, alt_u32 status)
+{
+  if (status & ALTERA_AVALON_UART_STATUS_FE_MSK)
+  {
+    sp->stats.rx_framing++;
+  }
+  else
+  {
+    sp->stats.rx_parity++;
+  }
+}
+
+/*
+ * altera_avalon_uart_rxhigh() records the most entries that have been in 
+ * use in the receive buffer. It is called each time rx_end moves on.
+ */
+static void 
+altera_avalon_uart_rxhigh(altera_avalon_uart_state* sp)
+{
+  alt_u32 used = (sp->rx_end - sp->rx_start) & sp->rx_msk;
+
+  if (used > sp->stats.rx_high)
+  {
+    sp->stats.rx_high = used;
+  }
+}
+
+#ifdef ALT_UART_LINES
+
+/*
+ * altera_avalon_uart_rxirq() is called by altera_avalon_uart_irq() to 
+ * process a receive interrupt. With ALT_UART_LINES the incoming character
+ * is appended to the line being assembled in slot rx_end. When a '\r' or
+ * '\n' arrives the line is complete, and rx_end moves on so that 
+ * altera_avalon_uart_getline() can collect it. Empty lines, such as the 
+ * second half of a "\r\n", are ignored.
+ *
+ * A zero byte instead starts a binary record, kept with its leading zero, 
+ * which ends at the next zero byte. Any unfinished line is discarded.
+ *
+ * Receive interrupts are never disabled in this mode. If the line is too 
+ * long, or there is no free slot to move on to, the line is discarded and 
+ * counted in rx_dropped.
+ */
+static void 
+altera_avalon_uart_rxirq(altera_avalon_uart_state* sp, alt_u32 status)
+{
+  alt_u32 next;
+  char    c;
+  
+  /* If there was an error, count and discard the data */
+
+  if (status & (ALTERA_AVALON_UART_STATUS_PE_MSK | 
+                  ALTERA_AVALON_UART_STATUS_FE_MSK))
+  {
+    altera_avalon_uart_rxerr(sp, status);
+    return;
+  }
+
+  c = IORD_ALTERA_AVALON_UART_RXDATA(sp->base);
+
+  if (!c && !(sp->line_binary && (sp->line_fill > 1)))
+  {
+    /* Start a binary record. Repeated zeros are taken as a single one */
+
+    if (sp->line_fill && !sp->line_binary)
+    {
+      sp->stats.rx_dropped++;
+    }
+    ALT_AVALON_UART_LINE(sp, sp->rx_end)[0] = 0;
+    sp->line_fill   = 1;
+    sp->line_binary = 1;
+    return;
+  }
+
+  if (c && (sp->line_binary || (c != '\r' && c != '\n')))
+  {
+    /* A line_fill beyond ALT_AVALON_UART_LINE_LEN marks an over-long line */
+
+    if (sp->line_fill < ALT_AVALON_UART_LINE_LEN)
+    {
+      ALT_AVALON_UART_LINE(sp, sp->rx_end)[sp->line_fill] = c;
+    }
+    if (sp->line_fill <= ALT_AVALON_UART_LINE_LEN)
+    {
+      sp->line_fill++;
+    }
+    return;
+  }
+
+  if (!sp->line_fill)
+  {
+    return;
+  }
+
+  next = (sp->rx_end + 1) & sp->rx_msk;
+
+  if ((sp->line_fill > ALT_AVALON_UART_LINE_LEN) || (next == sp->rx_start))
+  {
+    sp->stats.rx_dropped++;
+  }
+  else
+  {
+    /*
+     * In a multi-threaded environment, set the read event flag to indicate
+     * that there is a line ready. This is only done if no lines were
+     * previously waiting.
+     */
+
+    if (sp->rx_end == sp->rx_start)
+    {
+      ALT_FLAG_POST (sp->events, ALT_UART_READ_RDY, OS_FLAG_SET);
+    }
+
+    sp->line_len[sp->rx_end] = sp->line_fill;
+    sp->rx_end = next;
+
+    altera_avalon_uart_rxhigh(sp);
+  }
+
+  sp->line_fill   = 0;
+  sp->line_binary = 0;
+}
+
+#else /* !ALT_UART_LINES */
+
 /*
  * altera_avalon_uart_rxirq() is called by altera_avalon_uart_irq() to 
  * process a receive interrupt. It transfers the incoming character into 
@@ -154,11 +291,12 @@ altera_avalon_uart_rxirq(altera_avalon_uart_state* sp, alt_u32 status)
 {
   alt_u32 next;
   
-  /* If there was an error, discard the data */
+  /* If there was an error, count and discard the data */
 
   if (status & (ALTERA_AVALON_UART_STATUS_PE_MSK | 
                   ALTERA_AVALON_UART_STATUS_FE_MSK))
   {
+    altera_avalon_uart_rxerr(sp, status);
     return;
   }
 
@@ -175,7 +313,7 @@ altera_avalon_uart_rxirq(altera_avalon_uart_state* sp, alt_u32 status)
 
   /* Determine which slot to use next in the circular buffer */
 
-  next = (sp->rx_end + 1) & ALT_AVALON_UART_BUF_MSK;
+  next = (sp->rx_end + 1) & sp->rx_msk;
 
   /* Transfer data from the device to the circular buffer */
 
@@ -183,7 +321,9 @@ altera_avalon_uart_rxirq(altera_avalon_uart_state* sp, alt_u32 status)
 
   sp->rx_end = next;
 
-  next = (sp->rx_end + 1) & ALT_AVALON_UART_BUF_MSK;
+  altera_avalon_uart_rxhigh(sp);
+
+  next = (sp->rx_end + 1) & sp->rx_msk;
 
   /*
    * If the cicular buffer was full, disable interrupts. Interrupts will be
@@ -197,6 +337,8 @@ altera_avalon_uart_rxirq(altera_avalon_uart_state* sp, alt_u32 status)
   }   
 }
 
+#endif /* ALT_UART_LINES */
+
 /*
  * altera_avalon_uart_txirq() is called by altera_avalon_uart_irq() to 
  * process a transmit interrupt. It transfers data from the transmit 
@@ -225,7 +367,7 @@ altera_avalon_uart_txirq(altera_avalon_uart_state* sp, alt_u32 status)
        * buffer was previously empty.
        */
 
-      if (sp->tx_start == ((sp->tx_end + 1) & ALT_AVALON_UART_BUF_MSK))
+      if (sp->tx_start == ((sp->tx_end + 1) & sp->tx_msk))
       { 
         ALT_FLAG_POST (sp->events, 
                        ALT_UART_WRITE_RDY,
@@ -236,7 +378,7 @@ altera_avalon_uart_txirq(altera_avalon_uart_state* sp, alt_u32 status)
 
       IOWR_ALTERA_AVALON_UART_TXDATA(sp->base, sp->tx_buf[sp->tx_start]);
 
-      sp->tx_start = (++sp->tx_start) & ALT_AVALON_UART_BUF_MSK;
+      sp->tx_start = (++sp->tx_start) & sp->tx_msk;
 
       /*
        * In case the tranmit interrupt had previously been disabled by 
@@ -56,8 +56,8 @@
 
 /*
  * altera_avalon_uart_ioctl() is called by the system ioctl() function to handle
- * ioctl requests for the UART. The only ioctl requests supported are TIOCMGET
- * and TIOCMSET.
+ * ioctl requests for the UART. The ioctl requests supported are TIOCMGET,
+ * TIOCMSET, TIOCGUARTSTATS and TIOCCUARTSTATS.
  *
  * TIOCMGET returns a termios structure that describes the current device
  * configuration.
@@ -65,12 +65,19 @@
  * TIOCMSET sets the device (if possible) to match the requested configuration.
  * The requested configuration is described using a termios structure passed
  * through the input argument "arg".
+ *
+ * TIOCGUARTSTATS copies the error and buffer usage counters into the 
+ * altera_avalon_uart_stats structure passed through "arg", and 
+ * TIOCCUARTSTATS resets them.
  */
 
 static int altera_avalon_uart_tiocmget(altera_avalon_uart_state* sp,
   struct termios* term);
 static int altera_avalon_uart_tiocmset(altera_avalon_uart_state* sp,
   struct termios* term);
+static int altera_avalon_uart_stats_get(altera_avalon_uart_state* sp,
+  altera_avalon_uart_stats* stats);
+static int altera_avalon_uart_stats_clear(altera_avalon_uart_state* sp);
 
 int 
 altera_avalon_uart_ioctl(altera_avalon_uart_state* sp, int req, void* arg)
@@ -85,6 +92,12 @@ altera_avalon_uart_ioctl(altera_avalon_uart_state* sp, int req, void* arg)
   case TIOCMSET:
     rc = altera_avalon_uart_tiocmset(sp, (struct termios*) arg);
     break;
+  case TIOCGUARTSTATS:
+    rc = altera_avalon_uart_stats_get(sp, (altera_avalon_uart_stats*) arg);
+    break;
+  case TIOCCUARTSTATS:
+    rc = altera_avalon_uart_stats_clear(sp);
+    break;
   default:
     break;
   }
@@ -148,6 +161,44 @@ altera_avalon_uart_tiocmset(altera_avalon_uart_state* sp,
   return 0;
 }
 
+/*
+ * altera_avalon_uart_stats_get() is used by altera_avalon_uart_ioctl() to 
+ * copy out the counters. Interrupts are disabled so that the copy is 
+ * consistent. The usable size of each buffer is filled in, one less than 
+ * its length since a full buffer keeps one entry free.
+ */
+
+static int 
+altera_avalon_uart_stats_get(altera_avalon_uart_state* sp,
+  altera_avalon_uart_stats* stats)
+{
+  alt_irq_context context;
+
+  context = alt_irq_disable_all ();
+  memcpy (stats, &sp->stats, sizeof (altera_avalon_uart_stats));
+  alt_irq_enable_all (context);
+
+  stats->rx_size = sp->rx_msk;
+  stats->tx_size = sp->tx_msk;
+  return 0;
+}
+
+/*
+ * altera_avalon_uart_stats_clear() is used by altera_avalon_uart_ioctl() to
+ * reset the counters and high water marks.
+ */
+
+static int 
+altera_avalon_uart_stats_clear(altera_avalon_uart_state* sp)
+{
+  alt_irq_context context;
+
+  context = alt_irq_disable_all ();
+  memset (&sp->stats, 0, sizeof (altera_avalon_uart_stats));
+  alt_irq_enable_all (context);
+  return 0;
+}
+
 #endif /* ALTERA_AVALON_UART_USE_IOCTL */
 
 #endif /* fast driver */
@@ -29,6 +29,7 @@
 ******************************************************************************/
 
 #include <fcntl.h>
+#include <string.h>
 
 #include "sys/alt_irq.h"
 #include "sys/ioctl.h"
@@ -103,6 +104,78 @@ altera_avalon_uart_read(altera_avalon_uart_state* sp, char* ptr, int len,
 /* ----------------------- FAST DRIVER ----------------------- */
 /* ----------------------------------------------------------- */
 
+#ifdef ALT_UART_LINES
+
+/*
+ * altera_avalon_uart_getline() is the line framed equivalent of 
+ * altera_avalon_uart_read(). The receive interrupt handler has already 
+ * assembled the incoming data into lines, so this copies out the oldest 
+ * complete line, without its '\r' or '\n', and releases its slot. A line 
+ * longer than "len" is truncated. Binary records start with their zero 
+ * byte, and are returned without the closing one.
+ *
+ * In non-blocking mode -EWOULDBLOCK is returned if no complete line has 
+ * been received yet, however many characters of the next line are waiting.
+ */
+
+int 
+altera_avalon_uart_getline(altera_avalon_uart_state* sp, char* ptr, int len,
+  int flags)
+{
+  int block;
+  int count;
+
+  block = !(flags & O_NONBLOCK);
+
+  ALT_SEM_PEND (sp->read_lock, 0);
+
+  while (sp->rx_start == sp->rx_end)
+  {
+    if (!block)
+    {
+      ALT_SEM_POST (sp->read_lock);
+      ALT_ERRNO = EWOULDBLOCK;
+      return -EWOULDBLOCK;
+    }
+
+    ALT_FLAG_PEND (sp->events, 
+                   ALT_UART_READ_RDY,
+                   OS_FLAG_WAIT_SET_ANY + OS_FLAG_CONSUME,
+                   0);
+  }
+
+  /* 
+   * Only the slot at rx_start is read here, and the interrupt handler does 
+   * not write to it until rx_start has moved past it.
+   */
+
+  count = sp->line_len[sp->rx_start];
+  if (count > len)
+  {
+    count = len;
+  }
+  memcpy (ptr, (const char*) ALT_AVALON_UART_LINE(sp, sp->rx_start), count);
+
+  sp->rx_start = (sp->rx_start + 1) & sp->rx_msk;
+
+  ALT_SEM_POST (sp->read_lock);
+
+  return count;
+}
+
+/*
+ * With line framing, read() returns one line per call.
+ */
+
+int 
+altera_avalon_uart_read(altera_avalon_uart_state* sp, char* ptr, int len,
+  int flags)
+{
+  return altera_avalon_uart_getline(sp, ptr, len, flags);
+}
+
+#else /* !ALT_UART_LINES */
+
 /*
  * altera_avalon_uart_read() is called by the system read() function in order to
  * read a block of data from the UART. "len" is the maximum length of the data
@@ -166,7 +239,7 @@ altera_avalon_uart_read(altera_avalon_uart_state* sp, char* ptr, int len,
       count++;
       *ptr++ = sp->rx_buf[sp->rx_start];
       
-      sp->rx_start = (sp->rx_start+1) & ALT_AVALON_UART_BUF_MSK;
+      sp->rx_start = (sp->rx_start+1) & sp->rx_msk;
     }
 
     /*
@@ -237,4 +310,6 @@ altera_avalon_uart_read(altera_avalon_uart_state* sp, char* ptr, int len,
   }
 }
 
+#endif /* ALT_UART_LINES */
+
 #endif /* fast driver */
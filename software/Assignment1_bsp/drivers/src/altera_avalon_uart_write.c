@@ -153,12 +153,15 @@ altera_avalon_uart_write(altera_avalon_uart_state* sp, const char* ptr, int len,
   {
     /* Determine the next slot in the buffer to access */
 
-    next = (sp->tx_end + 1) & ALT_AVALON_UART_BUF_MSK;
+    next = (sp->tx_end + 1) & sp->tx_msk;
 
     /* block waiting for space if necessary */
 
     if (next == sp->tx_start)
     {
+      sp->stats.tx_full++;
+      sp->stats.tx_high = sp->tx_msk;
+
       if (no_block)
       {
         /* Set errno to indicate why this function returned early */
@@ -206,6 +209,17 @@ altera_avalon_uart_write(altera_avalon_uart_state* sp, const char* ptr, int len,
     sp->tx_end = next;
   }
 
+  /* 
+   * Record the most characters queued. The buffer only drains while the 
+   * loop above runs, so unless it was found full the high point is now.
+   */
+
+  next = (sp->tx_end - sp->tx_start) & sp->tx_msk;
+  if (next > sp->stats.tx_high)
+  {
+    sp->stats.tx_high = next;
+  }
+
   /*
    * Now that access to the circular buffer is complete, release the write
    * semaphore so that other threads can access the buffer.
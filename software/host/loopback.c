@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+#include "tlcproto.h"
+#include "proto.h"
+
+// Loopback test of the binary protocol, run on the host with "make test".
+// Requests are built with the tlc_ functions, cut into records the way the
+// uart driver does, passed to the controller's proto_input(), and its reply
+// frames are fed back through tlc_receive(). No hardware or HAL is needed.
+
+#define DRIVER_SLOT 64 // ALT_AVALON_UART_LINE_LEN, the longest record the uart driver returns.
+
+static int Failures = 0;
+static int TimingCalls = 0;
+static alt_u8 LastTiming[1 + 2 * TLC_TIMEOUTS];
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static void check(int ok, const char *text, int line) {
+	if (!ok) {
+		printf("loopback.c:%d: failed: %s\n", line, text);
+		Failures++;
+	}
+}
+
+static int timing_handler(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	if (length != sizeof(LastTiming)) {
+		return FRAME_BAD_LENGTH;
+	}
+	memcpy(LastTiming, request, length);
+	TimingCalls++;
+	return FRAME_OK;
+}
+
+static int counters_handler(const alt_u8 *request, int length, alt_u8 *reply, int *reply_length) {
+	int i;
+
+	for (i = 0; i < FRAME_COUNTER_VALUES; i++) {
+		frame_put32(&reply[4 * i], 0x01020300 + i); // A zero byte in every value.
+	}
+	*reply_length = 4 * FRAME_COUNTER_VALUES;
+	return FRAME_OK;
+}
+
+static int exchange(Proto *proto, const alt_u8 *frame, int length, TlcReceiver *receiver, TlcReply *reply) {
+	// Send one request frame through the controller and collect the reply.
+	// Returns the number of replies received.
+	FILE *out = tmpfile();
+	int replies = 0;
+	int c;
+
+	// The driver returns the record from the opening zero up to the closing
+	// one, and drops records that don't fit its slot.
+	CHECK(frame[0] == 0 && frame[length - 1] == 0);
+	CHECK(length - 1 <= DRIVER_SLOT);
+	proto_input(proto, out, &frame[1], length - 2);
+
+	rewind(out);
+	while ((c = fgetc(out)) != EOF) {
+		replies += tlc_receive(receiver, c, reply);
+	}
+	fclose(out);
+	return replies;
+}
+
+int main(void) {
+	static const alt_u16 timeouts[TLC_TIMEOUTS] = {500, 6000, 2000, 500, 6000, 2000};
+	alt_u8 message[FRAME_MAX_MESSAGE + 2];
+	alt_u8 frame[FRAME_MAX_ENCODED];
+	alt_u8 body[FRAME_MAX_ENCODED + 256];
+	TlcReceiver receiver;
+	TlcReply reply;
+	Proto proto;
+	int length;
+	int i;
+
+	proto_init(&proto);
+	proto_add(&proto, FRAME_TIMING, timing_handler);
+	proto_add(&proto, FRAME_COUNTERS, counters_handler);
+	tlc_receiver_init(&receiver);
+
+	// A request and its reply, end to end.
+	length = tlc_timing(frame, 7, timeouts, 0);
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1);
+	CHECK(reply.type == FRAME_TIMING && reply.sequence == 7 && reply.status == FRAME_OK && reply.length == 0);
+	CHECK(TimingCalls == 1);
+	CHECK(LastTiming[0] == 0 && frame_get16(&LastTiming[1]) == 500 && frame_get16(&LastTiming[11]) == 2000);
+
+	// A retry of the same sequence is answered again without rerunning the handler.
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1);
+	CHECK(reply.type == FRAME_TIMING && reply.sequence == 7 && reply.status == FRAME_OK);
+	CHECK(TimingCalls == 1 && proto.retries == 1);
+
+	// The next sequence number runs it.
+	length = tlc_timing(frame, 8, timeouts, 1);
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1);
+	CHECK(reply.sequence == 8 && TimingCalls == 2 && LastTiming[0] == 1);
+
+	// A corrupted frame is counted and not answered.
+	length = tlc_timing(frame, 9, timeouts, 0);
+	frame[5] ^= 0x10;
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 0);
+	CHECK(proto.errors == 1 && TimingCalls == 2);
+
+	// Unknown types get a status rather than silence.
+	length = tlc_mode(frame, 10, 3);
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1);
+	CHECK(reply.type == FRAME_MODE && reply.status == FRAME_UNKNOWN);
+
+	// The longest reply, with zeros in its data.
+	length = tlc_counters(frame, 11);
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1);
+	CHECK(reply.status == FRAME_OK && reply.length == 4 * FRAME_COUNTER_VALUES);
+	CHECK(tlc_counter(&reply, FRAME_COUNT_SWAPS) == 0x01020300);
+	CHECK(tlc_counter(&reply, FRAME_COUNT_FRAME_ERRORS) == 0x01020309);
+
+	// A maximum length message fills the driver's slot exactly, and one byte
+	// more is refused by the encoder.
+	for (i = 0; i < FRAME_MAX_MESSAGE; i++) {
+		message[i] = i + 1;
+	}
+	length = frame_encode(frame, message, FRAME_MAX_MESSAGE);
+	CHECK(length == FRAME_MAX_ENCODED);
+	CHECK(length - 1 == DRIVER_SLOT);
+	CHECK(frame_decode(message, &frame[1], length - 2) == FRAME_MAX_MESSAGE);
+	CHECK(message[0] == 1 && message[FRAME_MAX_MESSAGE - 1] == FRAME_MAX_MESSAGE);
+	CHECK(frame_encode(frame, message, FRAME_MAX_MESSAGE + 1) == 0);
+
+	// A full 254 byte COBS block, code 0xff, is well formed but longer than any
+	// message, so it is refused without writing past the message buffer.
+	body[0] = 0xff;
+	for (i = 1; i < 0xff; i++) {
+		body[i] = i;
+	}
+	body[0xff] = 0x01;
+	CHECK(frame_decode(message, body, 0x100) == -1);
+
+	// Blocks that end exactly at the last byte, and one cut short.
+	CHECK(frame_decode(message, body, 0) == -1);
+	body[0] = 0x05;
+	CHECK(frame_decode(message, body, 3) == -1);
+
+	// A frame too long for the host's buffer is counted, and the receiver
+	// picks up again at the next frame.
+	receiver.errors = 0;
+	tlc_receive(&receiver, 0, &reply);
+	for (i = 0; i < FRAME_MAX_ENCODED + 10; i++) {
+		tlc_receive(&receiver, 0x55, &reply);
+	}
+	CHECK(tlc_receive(&receiver, 0, &reply) == 0 && receiver.errors == 1);
+	length = tlc_timing(frame, 12, timeouts, 0);
+	CHECK(exchange(&proto, frame, length, &receiver, &reply) == 1 && reply.sequence == 12);
+
+	if (Failures != 0) {
+		printf("%d checks failed\n", Failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <string.h>
+#include "tlcproto.h"
+
+static int tlc_request(alt_u8 *frame, int type, int sequence, const alt_u8 *payload, int length) {
+	alt_u8 message[FRAME_MAX_MESSAGE];
+
+	message[0] = type;
+	message[1] = sequence;
+	if (length > 0) {
+		memcpy(&message[2], payload, length);
+	}
+	return frame_encode(frame, message, length + 2);
+}
+
+static void tlc_put_timeouts(alt_u8 *data, const alt_u16 *timeouts) {
+	int i;
+
+	for (i = 0; i < TLC_TIMEOUTS; i++) {
+		frame_put16(&data[2 * i], timeouts[i]);
+	}
+}
+
+int tlc_timing(alt_u8 *frame, int sequence, const alt_u16 *timeouts, int flash) {
+	// t0..t5 in ms, each 1..9998. They are ignored when flashing.
+	alt_u8 payload[1 + 2 * TLC_TIMEOUTS];
+
+	payload[0] = flash != 0;
+	tlc_put_timeouts(&payload[1], timeouts);
+	return tlc_request(frame, FRAME_TIMING, sequence, payload, sizeof(payload));
+}
+
+int tlc_plan(alt_u8 *frame, int sequence, int index, int start, const alt_u16 *timeouts, int flash) {
+	// Replace plan "index", or add one after the last. "start" is the minute of
+	// the day, and must fall between the starts of the plans either side.
+	alt_u8 payload[4 + 2 * TLC_TIMEOUTS];
+
+	payload[0] = index;
+	frame_put16(&payload[1], start);
+	payload[3] = flash != 0;
+	tlc_put_timeouts(&payload[4], timeouts);
+	return tlc_request(frame, FRAME_PLAN, sequence, payload, sizeof(payload));
+}
+
+int tlc_mode(alt_u8 *frame, int sequence, int mode) {
+	alt_u8 payload[1];
+
+	payload[0] = mode;
+	return tlc_request(frame, FRAME_MODE, sequence, payload, sizeof(payload));
+}
+
+int tlc_counters(alt_u8 *frame, int sequence) {
+	return tlc_request(frame, FRAME_COUNTERS, sequence, NULL, 0);
+}
+
+int tlc_log(alt_u8 *frame, int sequence, int log) {
+	alt_u8 payload[1];
+
+	payload[0] = log;
+	return tlc_request(frame, FRAME_LOG, sequence, payload, sizeof(payload));
+}
+
+int tlc_rate(alt_u8 *frame, int sequence, int rate) {
+	// Telemetry rate in Hz, 1..100, or 0 to stop it.
+	alt_u8 payload[1];
+
+	payload[0] = rate;
+	return tlc_request(frame, FRAME_TELEMETRY, sequence, payload, sizeof(payload));
+}
+
+void tlc_receiver_init(TlcReceiver *receiver) {
+	receiver->length = -1;
+	receiver->errors = 0;
+}
+
+int tlc_receive(TlcReceiver *receiver, alt_u8 byte, TlcReply *reply) {
+	// Feed one byte read from the port. Returns 1 when it completes a reply or
+	// a telemetry record, which is decoded into "reply". Bytes outside frames
+	// are console text and are skipped.
+	int length;
+
+	if (byte != 0) {
+		if (receiver->length >= 0 && receiver->length < FRAME_MAX_ENCODED) {
+			receiver->body[receiver->length] = byte;
+		}
+		if (receiver->length >= 0 && receiver->length <= FRAME_MAX_ENCODED) {
+			receiver->length++;
+		}
+		return 0;
+	}
+	length = receiver->length;
+	if (length <= 0) {
+		receiver->length = 0; // An opening zero, or repeated zeros.
+		return 0;
+	}
+	receiver->length = -1;
+	if (length > FRAME_MAX_ENCODED) {
+		receiver->errors++;
+		return 0;
+	}
+	length = frame_decode(reply->message, receiver->body, length);
+	if (length >= 2 && reply->message[0] == FRAME_TELEMETRY) {
+		reply->type = FRAME_TELEMETRY;
+		reply->sequence = reply->message[1];
+		reply->status = FRAME_OK;
+		reply->data = &reply->message[2];
+		reply->length = length - 2;
+		return 1;
+	}
+	if (length < 3 || !(reply->message[0] & FRAME_REPLY)) {
+		receiver->errors++;
+		return 0;
+	}
+	reply->type = reply->message[0] & ~FRAME_REPLY;
+	reply->sequence = reply->message[1];
+	reply->status = reply->message[2];
+	reply->data = &reply->message[3];
+	reply->length = length - 3;
+	return 1;
+}
+
+alt_u32 tlc_counter(const TlcReply *reply, int counter) {
+	// One value from a FRAME_COUNTERS reply, FRAME_COUNT_SWAPS etc.
+	if (reply->type != FRAME_COUNTERS || reply->length < 4 * (counter + 1)) {
+		return 0;
+	}
+	return frame_get32(&reply->data[4 * counter]);
+}
+
+int tlc_telemetry(const TlcReply *reply, TlcTelemetry *record) {
+	// Unpack a telemetry record. Returns 0 if "reply" is not one.
+	const alt_u8 *data = reply->data;
+
+	if (reply->type != FRAME_TELEMETRY || reply->length < TELEMETRY_RECORD) {
+		return 0;
+	}
+	record->sequence = reply->sequence;
+	record->tick = frame_get32(&data[0]);
+	record->mode = data[4];
+	record->state = data[5];
+	record->flags = data[6];
+	record->remaining = frame_get16(&data[7]);
+	record->detections[0] = frame_get16(&data[9]);
+	record->detections[1] = frame_get16(&data[11]);
+	record->dropped = frame_get16(&data[13]);
+	return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef TLCPROTO_H_
+#define TLCPROTO_H_
+
+#include "alt_types.h"
+#include "frame.h"
+#include "telemetry.h"
+
+// Host side of the binary uart protocol (../Assignment1/frame.h). The tlc_
+// request functions each build one complete frame, ready to write to the
+// serial port, and return its length. Bytes read back from the port are fed
+// to tlc_receive(), which picks the reply frames out from any console text
+// around them. Shares frame.c with the controller:
+//
+//     cc -I../Assignment1 -I../Assignment1_bsp/HAL/inc -c tlcproto.c ../Assignment1/frame.c
+//
+// "make test" runs loopback.c, which passes requests through the controller's
+// proto.c and back.
+//
+// Requests are not retried here. A caller that times out waiting for a reply
+// sends the same frame again, and the controller answers a repeated sequence
+// number from its saved reply without running the request twice.
+
+#define TLC_TIMEOUTS 6 // t0..t5
+
+typedef struct {
+	int type;                       // Request type answered, without FRAME_REPLY, or FRAME_TELEMETRY for a record.
+	int sequence;
+	int status;                     // FRAME_OK etc. Always FRAME_OK for a record.
+	const alt_u8 *data;             // Reply data, after the status.
+	int length;
+	alt_u8 message[FRAME_MAX_MESSAGE + 2];
+} TlcReply;
+
+// A telemetry record (../Assignment1/telemetry.h).
+typedef struct {
+	int sequence;
+	alt_u32 tick;
+	int mode;
+	int state;
+	int flags;                      // TELEMETRY_EW_PED etc.
+	int remaining;                  // ms to the next transition.
+	int detections[2];              // EW, NS. These wrap at 16 bits.
+	int dropped;                    // Records lost so far, wrapping at 16 bits.
+} TlcTelemetry;
+
+typedef struct {
+	alt_u8 body[FRAME_MAX_ENCODED];
+	int length;                     // -1 outside a frame.
+	unsigned long errors;           // Frames that were too long or failed their CRC.
+} TlcReceiver;
+
+int tlc_timing(alt_u8 *frame, int sequence, const alt_u16 *timeouts, int flash);
+int tlc_plan(alt_u8 *frame, int sequence, int index, int start, const alt_u16 *timeouts, int flash);
+int tlc_mode(alt_u8 *frame, int sequence, int mode);
+int tlc_counters(alt_u8 *frame, int sequence);
+int tlc_log(alt_u8 *frame, int sequence, int log);
+int tlc_rate(alt_u8 *frame, int sequence, int rate);
+
+void tlc_receiver_init(TlcReceiver *receiver);
+int tlc_receive(TlcReceiver *receiver, alt_u8 byte, TlcReply *reply);
+alt_u32 tlc_counter(const TlcReply *reply, int counter);
+int tlc_telemetry(const TlcReply *reply, TlcTelemetry *record);
+
+#endif /* TLCPROTO_H_ */